@@ -39,7 +39,10 @@
 #include <asm/switch_to.h>
 #include <asm/desc.h>
 #include <asm/prctl.h>
+#include <asm/tsc.h>
 #include <linux/cpumask.h>
+#include <linux/math64.h>
+#include <linux/offsched.h>
 
 /*
  * per-CPU TSS segments. Threads are completely 'soft' on Linux,
@@ -332,6 +335,7 @@ void arch_cpu_idle_enter(void)
 {
 	tsc_verify_tsc_adjust(false);
 	local_touch_nmi();
+	offsched_park_idle();	/* OFFSCHED */
 }
 
 void arch_cpu_idle_dead(void)
@@ -688,7 +692,7 @@ bool is_offsched_callback(int cpuid)
 {
 	struct offsched_cpu *cpu = &per_cpu(__offsched_cpu, cpuid);
 
-	return cpu->callback == NULL;
+	return cpu->callback != NULL;
 }
 
 void run_offsched_callback(void)
@@ -699,4 +703,59 @@ void run_offsched_callback(void)
 	set_cpu_offsched(cpuid, true);
 	cpu->callback();
 	set_cpu_offsched(cpuid, false);
+	offsched_cpu_exited(cpuid);
+}
+
+/*
+ * Wait until *@addr stops holding @old. A store to the monitored line ends
+ * MWAIT, and so does an interrupt: a wakeup IPI or the slice timer.
+ * Returns false if MWAIT isn't available and the caller has to poll.
+ */
+bool offsched_mwait(unsigned long *addr, unsigned long old, unsigned int hint)
+{
+	if (!this_cpu_has(X86_FEATURE_MWAIT))
+		return false;
+
+	if (this_cpu_has(X86_BUG_CLFLUSH_MONITOR)) {
+		mb();
+		clflush(addr);
+		mb();
+	}
+
+	__monitor(addr, 0, 0);
+	if (READ_ONCE(*addr) == old)
+		__mwait(hint, 0);
+
+	return true;
+}
+
+/*
+ * Slice timer of an offsched CPU. The local APIC timer is put in
+ * TSC-deadline mode and raises RESCHEDULE_VECTOR, so expiry lands in
+ * scheduler_ipi() and the clockevents/tick machinery stays off the CPU.
+ */
+bool offsched_timer_arm(u64 delta_ns)
+{
+	u64 deadline;
+
+	if (!this_cpu_has(X86_FEATURE_TSC_DEADLINE_TIMER))
+		return false;
+
+	deadline = rdtsc() + mul_u64_u32_div(delta_ns, tsc_khz, USEC_PER_SEC);
+
+	apic_write(APIC_LVTT, RESCHEDULE_VECTOR | APIC_LVT_TIMER_TSCDEADLINE);
+	/* See Intel SDM: TSC-Deadline Mode chapter */
+	asm volatile("mfence" : : : "memory");
+	wrmsrl(MSR_IA32_TSC_DEADLINE, deadline);
+
+	return true;
+}
+
+void offsched_timer_cancel(void)
+{
+	if (!this_cpu_has(X86_FEATURE_TSC_DEADLINE_TIMER))
+		return;
+
+	wrmsrl(MSR_IA32_TSC_DEADLINE, 0);
+	apic_write(APIC_LVTT, APIC_LVT_MASKED);
 }
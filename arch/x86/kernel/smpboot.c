@@ -56,6 +56,7 @@
 #include <linux/stackprotector.h>
 #include <linux/gfp.h>
 #include <linux/cpuidle.h>
+#include <linux/stop_machine.h>
 #include <linux/offsched.h>
 
 #include <asm/acpi.h>
@@ -902,6 +903,17 @@ void common_cpu_up(unsigned int cpu, struct task_struct *idle)
 #endif
 }
 
+/*
+ * OFFSCHED: once its offsched callback returned, a CPU that went down with
+ * cpu_down() waits in offsched_play_dead() for do_boot_cpu() to flip this
+ * word. It then jumps to initial_code on initial_stack, like start_cpu0()
+ * does for CPU0, so coming back online needs no INIT/SIPI.
+ */
+#define OFFSCHED_DEAD_PARKED	1
+#define OFFSCHED_DEAD_KICKED	2
+
+static DEFINE_PER_CPU_ALIGNED(unsigned long, offsched_dead);
+
 /*
  * NOTE - on most systems this is a PHYSICAL apic ID, but on multiquad
  * (ie clustered apic addressing mode), this is a LOGICAL apic ID.
@@ -918,6 +930,10 @@ static int do_boot_cpu(int apicid, int cpu, struct task_struct *idle,
 
 	unsigned long boot_error = 0;
 	unsigned long timeout;
+	bool kick;
+
+	/* OFFSCHED: only we move it out of PARKED, this can't change */
+	kick = READ_ONCE(per_cpu(offsched_dead, cpu)) == OFFSCHED_DEAD_PARKED;
 
 	idle->thread.sp = (unsigned long)task_pt_regs(idle);
 	early_gdt_descr.address = (unsigned long)get_cpu_gdt_rw(cpu);
@@ -935,7 +951,7 @@ static int do_boot_cpu(int apicid, int cpu, struct task_struct *idle,
 	 * the targeted processor.
 	 */
 
-	if (get_uv_system_type() != UV_NON_UNIQUE_APIC) {
+	if (get_uv_system_type() != UV_NON_UNIQUE_APIC && !kick) {
 
 		pr_debug("Setting warm reset code and vector.\n");
 
@@ -960,11 +976,14 @@ static int do_boot_cpu(int apicid, int cpu, struct task_struct *idle,
 
 	/*
 	 * Wake up a CPU in difference cases:
+	 * - Kick it out of offsched_play_dead() if it waits there
 	 * - Use the method in the APIC driver if it's defined
 	 * Otherwise,
 	 * - Use an INIT boot APIC message for APs or NMI for BSP.
 	 */
-	if (apic->wakeup_secondary_cpu)
+	if (kick)
+		WRITE_ONCE(per_cpu(offsched_dead, cpu), OFFSCHED_DEAD_KICKED);
+	else if (apic->wakeup_secondary_cpu)
 		boot_error = apic->wakeup_secondary_cpu(apicid, start_ip);
 	else
 		boot_error = wakeup_cpu_via_init_nmi(cpu, start_ip, apicid,
@@ -1007,7 +1026,7 @@ static int do_boot_cpu(int apicid, int cpu, struct task_struct *idle,
 	/* mark "stuck" area as not stuck */
 	*trampoline_status = 0;
 
-	if (get_uv_system_type() != UV_NON_UNIQUE_APIC) {
+	if (get_uv_system_type() != UV_NON_UNIQUE_APIC && !kick) {
 		/*
 		 * Cleanup possible dangling ends...
 		 */
@@ -1605,19 +1624,97 @@ void hlt_play_dead(void)
 	}
 }
 
+/*
+ * OFFSCHED: offsched_park() takes an online CPU to offsched duty without
+ * cpu_down(), see kernel/sched/offsched_park.c for the handshake.
+ */
+
+/*
+ * Stopper of the parking CPU: move its tasks away as sched_cpu_dying() does
+ * on the way down. It has to look offline for that, so that nothing is
+ * sent back here, but its idle task must find it online again.
+ */
+int arch_offsched_evict(void *unused)
+{
+	int cpu = smp_processor_id();
+
+	local_irq_disable();
+	lock_vector_lock();
+	set_cpu_online(cpu, false);
+	unlock_vector_lock();
+
+	sched_cpu_dying(cpu);
+
+	lock_vector_lock();
+	set_cpu_online(cpu, true);
+	unlock_vector_lock();
+	local_irq_enable();
+
+	/* Parks once we return, like take_cpu_down() */
+	stop_machine_park(cpu);
+
+	return 0;
+}
+
+/* The idle task leaves the online map for good, IRQs go elsewhere */
+void arch_offsched_park_cpu(void)
+{
+	lock_vector_lock();
+	set_cpu_online(smp_processor_id(), false);
+	unlock_vector_lock();
+	fixup_irqs();
+	lapic_offline();
+}
+
+/* start_secondary() minus what the park left in place */
+void arch_offsched_unpark_cpu(void)
+{
+	lock_vector_lock();
+	set_cpu_online(smp_processor_id(), true);
+	lapic_online();
+	unlock_vector_lock();
+
+	x86_cpuinit.setup_percpu_clockev();
+}
+
+/*
+ * Wait for do_boot_cpu() to kick us, then restart in start_secondary().
+ * MWAIT hint 0 (C1) keeps the caches, so unlike mwait_play_dead() there
+ * is no WBINVD on the way in. Only returns without MWAIT.
+ */
+static void offsched_play_dead(void)
+{
+	unsigned long *word = this_cpu_ptr(&offsched_dead);
+
+	if (!this_cpu_has(X86_FEATURE_MWAIT))
+		return;
+
+	WRITE_ONCE(*word, OFFSCHED_DEAD_PARKED);
+
+	while (READ_ONCE(*word) != OFFSCHED_DEAD_KICKED)
+		offsched_mwait(word, OFFSCHED_DEAD_PARKED, 0);
+
+	WRITE_ONCE(*word, 0);
+	start_cpu0();
+}
+
 void native_play_dead(void)
 {
 	int cpu = raw_smp_processor_id();
+	bool offsched = is_offsched_callback(cpu);
 
 	play_dead_common();
 	tboot_shutdown(TB_SHUTDOWN_WFS);
 
 	/* OFFSCHED */
-	if (is_offsched_callback(cpu))
+	if (offsched)
 		run_offsched_callback();
 
 	idle_task_exit();
 
+	if (offsched)
+		offsched_play_dead();	/* Only returns without MWAIT */
+
 	mwait_play_dead();	/* Only returns on failure */
 	if (cpuidle_play_dead())
 		hlt_play_dead();
@@ -1,14 +1,57 @@
 #ifndef _LINUX_OFFSCHED_H
 #define _LINUX_OFFSCHED_H
 
+#include <linux/percpu.h>
+
+struct task_struct;
+
 extern int register_offsched_callback(void (*offsched_callback)(void),
 	int cpuid);
 extern void unregister_offsched_callback(int cpuid);
-extern int is_offsched_callback(int cpuid);
+extern bool is_offsched_callback(int cpuid);
 extern void run_offsched_callback(void);
+extern bool offsched_mwait(unsigned long *addr, unsigned long old,
+	unsigned int hint);
+extern bool offsched_timer_arm(u64 delta_ns);
+extern void offsched_timer_cancel(void);
 
 extern void offsched_begin(void);
 extern void offsched_end(void);
+extern void offsched_cpu_exited(int cpu);
 extern void offsched_idle(void);
 
+extern int offsched_switch_to(struct task_struct *p);
+
+#ifdef CONFIG_HOTPLUG_CPU
+/* offsched_park() handshake with the parking CPU, in this order */
+enum offsched_park_state {
+	OFFSCHED_PARK_NONE,
+	OFFSCHED_PARK_REQUEST,		/* waiting for the CPU to go idle */
+	OFFSCHED_PARK_SYNC,		/* offline, serving late IPIs */
+	OFFSCHED_PARK_GO,
+	OFFSCHED_PARKED,		/* running the offsched callback */
+	OFFSCHED_UNPARK,		/* waiting for offsched_unpark_fn() */
+	OFFSCHED_UNPARK_GO,
+};
+
+DECLARE_PER_CPU(int, offsched_park_state);
+
+extern int offsched_park(unsigned int cpu);
+extern void offsched_park_play(void);
+
+extern int arch_offsched_evict(void *unused);
+extern void arch_offsched_park_cpu(void);
+extern void arch_offsched_unpark_cpu(void);
+
+/* From the idle loop, with interrupts off */
+static inline void offsched_park_idle(void)
+{
+	if (unlikely(this_cpu_read(offsched_park_state) ==
+		     OFFSCHED_PARK_REQUEST))
+		offsched_park_play();
+}
+#else
+static inline void offsched_park_idle(void) { }
+#endif
+
 #endif /* _LINUX_OFFSCHED_H */
@@ -1,12 +1,29 @@
 #ifndef _LINUX_OFFSCHED_LOG_H
 #define _LINUX_OFFSCHED_LOG_H
 
+#include <linux/types.h>
+#include <linux/jump_label.h>
+#include <uapi/linux/offsched_log.h>
+
 extern void offsched_log_init(void);
 
-extern volatile bool offsched_flags[10];
+/* One key per event, flipped by offsched_log_set_events() */
+extern struct static_key_false offsched_log_keys[OFFSCHED_LOG_NR_EVENTS];
+
+extern unsigned long offsched_log_events(void);
+extern int offsched_log_set_events(unsigned long mask);
+
+extern void offsched_log_event(unsigned int event, pid_t pid, u64 payload);
+
+/* @event must be a constant for the key to patch in place */
+#define offsched_log_enabled(event) \
+	static_branch_unlikely(&offsched_log_keys[event])
 
-extern int offsched_log_str(const char *str);
-extern int offsched_log_raw(void *ptr, int bytes);
-extern void offsched_log_nl(void);
+static __always_inline void offsched_log(unsigned int event, pid_t pid,
+					 u64 payload)
+{
+	if (offsched_log_enabled(event))
+		offsched_log_event(event, pid, payload);
+}
 
 #endif
@@ -521,7 +521,23 @@ struct wake_q_node {
 struct offsched_entity {
 	struct list_head	list;
 	int			cpu;
-	unsigned long		jiffies;
+	int			prio;
+	u64			exec_start;
+	u64			slice;
+	unsigned int		flags;		/* SCHED_FLAG_OFFSCHED_* */
+
+	/* EDF mode, see SCHED_FLAG_OFFSCHED_EDF */
+	struct rb_node		rb_node;
+	u64			dl_runtime;	/* Maximum runtime per period */
+	u64			dl_deadline;	/* Relative deadline */
+	u64			dl_period;
+	u64			dl_bw;		/* dl_runtime / dl_period */
+	int			edf_cpu;	/* CPU dl_bw is charged to */
+	s64			runtime;	/* Remaining runtime */
+	u64			deadline;	/* Absolute deadline, rq_clock() */
+
+	bool			drained;	/* Left by an exiting CPU, to revert */
+	int			push_cpu;	/* Asked for by sched_setattr(), or -1 */
 };
 
 struct task_struct {
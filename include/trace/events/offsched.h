@@ -0,0 +1,192 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM sched
+#define TRACE_INCLUDE_FILE offsched
+
+#if !defined(_TRACE_OFFSCHED_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_OFFSCHED_H
+
+#include <linux/sched.h>
+#include <linux/tracepoint.h>
+
+/*
+ * OFFSCHED: events of the offsched class, in the sched system next to
+ * sched_switch and sched_wakeup. Offsched CPUs take no ticks, select the
+ * x86-tsc trace clock to line them up with the rest of the machine.
+ */
+
+/*
+ * Tracepoint for an offsched task entering, leaving or dying on @cpu:
+ */
+DECLARE_EVENT_CLASS(sched_offsched_task_template,
+
+	TP_PROTO(struct task_struct *p, int cpu, unsigned int nr_running),
+
+	TP_ARGS(p, cpu, nr_running),
+
+	TP_STRUCT__entry(
+		__array(	char,	comm,	TASK_COMM_LEN	)
+		__field(	pid_t,	pid			)
+		__field(	int,	prio			)
+		__field(	int,	edf			)
+		__field(	int,	cpu			)
+		__field(	unsigned int,	nr_running	)
+	),
+
+	TP_fast_assign(
+		memcpy(__entry->comm, p->comm, TASK_COMM_LEN);
+		__entry->pid		= p->pid;
+		__entry->prio		= p->rt_priority;
+		__entry->edf		= !!(p->offsched.flags &
+					     SCHED_FLAG_OFFSCHED_EDF);
+		__entry->cpu		= cpu;
+		__entry->nr_running	= nr_running;
+	),
+
+	TP_printk("comm=%s pid=%d prio=%d edf=%d cpu=%03d nr_running=%u",
+		  __entry->comm, __entry->pid, __entry->prio, __entry->edf,
+		  __entry->cpu, __entry->nr_running)
+);
+
+DEFINE_EVENT(sched_offsched_task_template, sched_offsched_enqueue,
+	     TP_PROTO(struct task_struct *p, int cpu, unsigned int nr_running),
+	     TP_ARGS(p, cpu, nr_running));
+
+DEFINE_EVENT(sched_offsched_task_template, sched_offsched_dequeue,
+	     TP_PROTO(struct task_struct *p, int cpu, unsigned int nr_running),
+	     TP_ARGS(p, cpu, nr_running));
+
+DEFINE_EVENT(sched_offsched_task_template, sched_offsched_task_dead,
+	     TP_PROTO(struct task_struct *p, int cpu, unsigned int nr_running),
+	     TP_ARGS(p, cpu, nr_running));
+
+/*
+ * Tracepoint for the offsched pick, @prev may be the idle task:
+ */
+TRACE_EVENT(sched_offsched_pick,
+
+	TP_PROTO(struct task_struct *prev, struct task_struct *next,
+		 unsigned int nr_running),
+
+	TP_ARGS(prev, next, nr_running),
+
+	TP_STRUCT__entry(
+		__field(	pid_t,	prev_pid		)
+		__array(	char,	next_comm,	TASK_COMM_LEN	)
+		__field(	pid_t,	next_pid		)
+		__field(	int,	next_prio		)
+		__field(	u64,	next_deadline		)
+		__field(	unsigned int,	nr_running	)
+	),
+
+	TP_fast_assign(
+		__entry->prev_pid	= prev->pid;
+		memcpy(__entry->next_comm, next->comm, TASK_COMM_LEN);
+		__entry->next_pid	= next->pid;
+		__entry->next_prio	= next->rt_priority;
+		__entry->next_deadline	= (next->offsched.flags &
+					   SCHED_FLAG_OFFSCHED_EDF) ?
+					  next->offsched.deadline : 0;
+		__entry->nr_running	= nr_running;
+	),
+
+	TP_printk("prev_pid=%d next_comm=%s next_pid=%d next_prio=%d next_deadline=%llu nr_running=%u",
+		  __entry->prev_pid, __entry->next_comm, __entry->next_pid,
+		  __entry->next_prio,
+		  (unsigned long long)__entry->next_deadline,
+		  __entry->nr_running)
+);
+
+/*
+ * Tracepoint for a CPU entering or leaving offsched:
+ */
+DECLARE_EVENT_CLASS(sched_offsched_cpu_template,
+
+	TP_PROTO(int cpu, unsigned int nr_running, int nr_total),
+
+	TP_ARGS(cpu, nr_running, nr_total),
+
+	TP_STRUCT__entry(
+		__field(	int,		cpu		)
+		__field(	unsigned int,	nr_running	)
+		__field(	int,		nr_total	)
+	),
+
+	TP_fast_assign(
+		__entry->cpu		= cpu;
+		__entry->nr_running	= nr_running;
+		__entry->nr_total	= nr_total;
+	),
+
+	TP_printk("cpu=%03d nr_running=%u nr_total=%d",
+		  __entry->cpu, __entry->nr_running, __entry->nr_total)
+);
+
+DEFINE_EVENT(sched_offsched_cpu_template, sched_offsched_begin,
+	     TP_PROTO(int cpu, unsigned int nr_running, int nr_total),
+	     TP_ARGS(cpu, nr_running, nr_total));
+
+DEFINE_EVENT(sched_offsched_cpu_template, sched_offsched_end,
+	     TP_PROTO(int cpu, unsigned int nr_running, int nr_total),
+	     TP_ARGS(cpu, nr_running, nr_total));
+
+/*
+ * Tracepoint for offsched_end() pushing the tasks left on @cpu away:
+ * @nr_moved in all, @nr_reverted of them to SCHED_NORMAL, in @delta_ns.
+ */
+TRACE_EVENT(sched_offsched_exit_migrate,
+
+	TP_PROTO(int cpu, unsigned int nr_moved, unsigned int nr_reverted,
+		 u64 delta_ns),
+
+	TP_ARGS(cpu, nr_moved, nr_reverted, delta_ns),
+
+	TP_STRUCT__entry(
+		__field(	int,		cpu		)
+		__field(	unsigned int,	nr_moved	)
+		__field(	unsigned int,	nr_reverted	)
+		__field(	u64,		delta_ns	)
+	),
+
+	TP_fast_assign(
+		__entry->cpu		= cpu;
+		__entry->nr_moved	= nr_moved;
+		__entry->nr_reverted	= nr_reverted;
+		__entry->delta_ns	= delta_ns;
+	),
+
+	TP_printk("cpu=%03d nr_moved=%u nr_reverted=%u delta_ns=%llu",
+		  __entry->cpu, __entry->nr_moved, __entry->nr_reverted,
+		  (unsigned long long)__entry->delta_ns)
+);
+
+/*
+ * Tracepoint for offsched_idle() done waiting, after @idle_ns:
+ */
+TRACE_EVENT(sched_offsched_idle_wake,
+
+	TP_PROTO(int cpu, u64 idle_ns, unsigned int nr_running),
+
+	TP_ARGS(cpu, idle_ns, nr_running),
+
+	TP_STRUCT__entry(
+		__field(	int,		cpu		)
+		__field(	u64,		idle_ns		)
+		__field(	unsigned int,	nr_running	)
+	),
+
+	TP_fast_assign(
+		__entry->cpu		= cpu;
+		__entry->idle_ns	= idle_ns;
+		__entry->nr_running	= nr_running;
+	),
+
+	TP_printk("cpu=%03d idle_ns=%llu nr_running=%u",
+		  __entry->cpu, (unsigned long long)__entry->idle_ns,
+		  __entry->nr_running)
+);
+
+#endif /* _TRACE_OFFSCHED_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
@@ -0,0 +1,70 @@
+/* SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note */
+#ifndef _UAPI_LINUX_OFFSCHED_LOG_H
+#define _UAPI_LINUX_OFFSCHED_LOG_H
+
+#include <linux/types.h>
+
+/*
+ * /dev/offsched_log maps the per-CPU offsched log rings, MAP_SHARED only.
+ * The ring of CPU n starts at offset n * size (see below) and holds:
+ *
+ *	page 0		struct offsched_log_index, read-only
+ *	page 1		struct offsched_log_consumer, the only writable page
+ *	page 2..	nr_blocks blocks of block_size bytes, read-only
+ *
+ * Map page 0 of CPU 0 first to learn size. The block at position pos
+ * (0 .. head - 1) is block pos & (nr_blocks - 1); a consumer reads seq,
+ * then len (acquire), copies len bytes of data and reads seq again. The
+ * copy is good if seq read pos + 1 both times. Only block head - 1 still
+ * grows, a position more than nr_blocks behind head has been overwritten.
+ * In OFFSCHED_LOG_STOP mode the CPU starts no block nr_blocks ahead of the
+ * consumer tail, store the tail (release) as blocks are done with.
+ *
+ * The records of a block are four unsigned LEB128 varints each: the event,
+ * the TSC delta from the previous record of the block (from the block tsc
+ * for the first one), the pid and the payload.
+ */
+#define OFFSCHED_LOG_VERSION	2
+
+#define OFFSCHED_LOG_STOP	(1U << 0)	/* keep the oldest blocks */
+
+#define OFFSCHED_LOG_BLOCK_SIZE	1024
+
+struct offsched_log_index {
+	__u32 version;
+	__u32 flags;
+	__u32 cpu;
+	__u32 block_size;
+	__u64 nr_blocks;	/* a power of 2 */
+	__u64 size;		/* bytes per CPU, pages 0 and 1 included */
+	__u64 head;		/* blocks started so far */
+	__u64 lost;		/* records dropped, OFFSCHED_LOG_STOP */
+};
+
+struct offsched_log_consumer {
+	__u64 tail;		/* blocks consumed so far */
+};
+
+enum offsched_log_event {
+	OFFSCHED_LOG_ENQUEUE,		/* payload: nr_running */
+	OFFSCHED_LOG_DEQUEUE,		/* payload: nr_running */
+	OFFSCHED_LOG_WAKEUP,		/* payload: remote wakeup */
+	OFFSCHED_LOG_TASK_DEAD,		/* payload: offsched CPU */
+	OFFSCHED_LOG_BEGIN,		/* payload: nr_running */
+	OFFSCHED_LOG_END,		/* payload: nr_running */
+	OFFSCHED_LOG_NR_EVENTS,
+};
+
+/*
+ * @seq is the position of the block plus one, 0 while it is being reset.
+ * @tsc is the TSC of the CPU at the first record.
+ */
+struct offsched_log_block {
+	__u64 seq;
+	__u64 tsc;
+	__u32 len;		/* bytes of records in data */
+	__u32 pad;
+	__u8 data[];
+};
+
+#endif /* _UAPI_LINUX_OFFSCHED_LOG_H */
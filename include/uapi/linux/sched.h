@@ -51,4 +51,13 @@
 #define SCHED_FLAG_RESET_ON_FORK	0x01
 #define SCHED_FLAG_RECLAIM		0x02
 
+/* OFFSCHED: SCHED_OFFSCHED only, kept clear of the generic flags */
+#define SCHED_FLAG_OFFSCHED_EDF		0x10000
+#define SCHED_FLAG_OFFSCHED_CPU		0x20000	/* run on sched_offsched_cpu */
+#define SCHED_FLAG_OFFSCHED_REVERT	0x40000	/* SCHED_NORMAL when the CPU leaves */
+
+#define SCHED_FLAG_OFFSCHED_ALL		(SCHED_FLAG_OFFSCHED_EDF | \
+					 SCHED_FLAG_OFFSCHED_CPU | \
+					 SCHED_FLAG_OFFSCHED_REVERT)
+
 #endif /* _UAPI_LINUX_SCHED_H */
@@ -517,8 +517,6 @@ asmlinkage __visible void __init start_kernel(void)
 	char *command_line;
 	char *after_dashes;
 
-	offsched_log_init();
-
 	set_task_stack_end_magic(&init_task);
 	smp_setup_processor_id();
 	debug_objects_early_init();
@@ -549,6 +547,7 @@ asmlinkage __visible void __init start_kernel(void)
 	setup_per_cpu_areas();
 	boot_cpu_state_init();
 	smp_prepare_boot_cpu();	/* arch-specific boot-cpu hooks */
+	offsched_log_init();	/* OFFSCHED: needs memblock and per-CPU areas */
 
 	build_all_zonelists(NULL);
 	page_alloc_init();
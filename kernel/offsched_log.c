@@ -1,67 +1,373 @@
+/*
+ * Offsched log: per-CPU rings of delta-encoded binary records.
+ *
+ * Offsched CPUs run with interrupts off and take no ticks, printk and the
+ * trace buffers are too heavy there. Each CPU writes its own ring and
+ * nothing else, with interrupts off, no lock taken. A ring is a run of
+ * fixed-size blocks that each start from an absolute TSC, the records in
+ * them are varints of the event, the TSC delta, the pid and the payload:
+ * 4 to 8 bytes for a usual record. A reader decodes any block on its own,
+ * so that overwriting the oldest ones loses no sync.
+ *
+ *	offsched_log_size=<size>	bytes of blocks per CPU, 0 disables
+ *	offsched_log_mode=stop		keep the oldest records when full,
+ *					the default is to overwrite them
+ *	offsched_log.events=<mask>	events to log, 1 << OFFSCHED_LOG_*,
+ *					/sys/kernel/offsched/log_events too
+ *
+ * Every event has a static key: a disabled event costs a NOP at its site.
+ *
+ * The rings come from memblock, on the node of their CPU, before the page
+ * allocator is up: offsched_log_init() runs right after the per-CPU areas
+ * are set up. /dev/offsched_log maps them to userspace, see
+ * include/uapi/linux/offsched_log.h for the layout.
+ */
 #include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/bootmem.h>
+#include <linux/log2.h>
+#include <linux/percpu.h>
+#include <linux/timex.h>
+#include <linux/sched.h>
+#include <linux/fs.h>
+#include <linux/mm.h>
+#include <linux/miscdevice.h>
+#include <linux/moduleparam.h>
+#include <linux/mutex.h>
+#include <linux/offsched_log.h>
 
-#define DATA_SIZE (1024 * 3)
+#define OFFSCHED_LOG_SIZE_DEFAULT	(64 * 1024)
 
-int offsched_log_str(const char *str);
+/* Largest record, 4 varints */
+#define OFFSCHED_LOG_REC_MAX	(5 + 10 + 5 + 10)
 
-volatile bool offsched_flags[10];
+#define OFFSCHED_LOG_BLOCK_DATA	\
+	(OFFSCHED_LOG_BLOCK_SIZE - sizeof(struct offsched_log_block))
 
-static struct {
-	int pos;
-	char data[DATA_SIZE];
-} log;
+/* Writer state, @index is page 0 of the ring, pages 1 and 2.. follow */
+struct offsched_log_cpu {
+	struct offsched_log_index *index;
+	struct offsched_log_block *block;	/* being filled */
+	u64 tsc;				/* of the last record */
+};
+
+static DEFINE_PER_CPU(struct offsched_log_cpu, offsched_log_cpu);
+
+static unsigned long offsched_log_size __initdata = OFFSCHED_LOG_SIZE_DEFAULT;
+static bool offsched_log_stop __read_mostly;
+
+/* Bytes per CPU, 0 if there is no log */
+static unsigned long offsched_log_bytes __read_mostly;
+
+struct static_key_false offsched_log_keys[OFFSCHED_LOG_NR_EVENTS] = {
+	[0 ... OFFSCHED_LOG_NR_EVENTS - 1] = STATIC_KEY_FALSE_INIT,
+};
+EXPORT_SYMBOL_GPL(offsched_log_keys);
+
+#define OFFSCHED_LOG_EVENTS_ALL	((1UL << OFFSCHED_LOG_NR_EVENTS) - 1)
+
+/* The keys follow the mask once jump labels are up */
+static DEFINE_MUTEX(offsched_log_mutex);
+static unsigned long offsched_log_mask;
+static bool offsched_log_keys_ready;
+
+static inline struct offsched_log_consumer *
+offsched_log_consumer(struct offsched_log_index *index)
+{
+	return (void *)index + PAGE_SIZE;
+}
+
+static inline struct offsched_log_block *
+offsched_log_block(struct offsched_log_index *index, unsigned long nr)
+{
+	return (void *)index + 2 * PAGE_SIZE + nr * OFFSCHED_LOG_BLOCK_SIZE;
+}
+
+static int __init offsched_log_size_setup(char *str)
+{
+	if (!str)
+		return -EINVAL;
+
+	offsched_log_size = memparse(str, &str);
+	return 0;
+}
+early_param("offsched_log_size", offsched_log_size_setup);
+
+static int __init offsched_log_mode_setup(char *str)
+{
+	if (!str)
+		return -EINVAL;
+
+	if (!strcmp(str, "stop"))
+		offsched_log_stop = true;
+	else if (!strcmp(str, "overwrite"))
+		offsched_log_stop = false;
+	else
+		return -EINVAL;
+
+	return 0;
+}
+early_param("offsched_log_mode", offsched_log_mode_setup);
 
 void __init offsched_log_init(void)
 {
-	int i;
+	struct offsched_log_index *index;
+	unsigned long nr_blocks, bytes;
+	int cpu;
+
+	nr_blocks = offsched_log_size / OFFSCHED_LOG_BLOCK_SIZE;
+	if (!nr_blocks)
+		return;
+	nr_blocks = roundup_pow_of_two(nr_blocks);
+	/* Whole pages, offsched_log_mmap() maps the rings back to back */
+	bytes = 2 * PAGE_SIZE + PAGE_ALIGN(nr_blocks * OFFSCHED_LOG_BLOCK_SIZE);
 
-	log.pos = 0;
+	for_each_possible_cpu(cpu) {
+		index = memblock_virt_alloc_try_nid_nopanic(bytes, PAGE_SIZE, 0,
+				BOOTMEM_ALLOC_ACCESSIBLE, cpu_to_node(cpu));
+		if (!index) {
+			pr_warn("offsched: no log for CPU%d\n", cpu);
+			continue;
+		}
 
-	for (i = 0; i < DATA_SIZE; i++) {
-		log.data[i] = 0;
+		index->version		= OFFSCHED_LOG_VERSION;
+		index->flags		= offsched_log_stop ? OFFSCHED_LOG_STOP : 0;
+		index->cpu		= cpu;
+		index->block_size	= OFFSCHED_LOG_BLOCK_SIZE;
+		index->nr_blocks	= nr_blocks;
+		index->size		= bytes;
+
+		per_cpu(offsched_log_cpu, cpu).index = index;
 	}
 
-	offsched_log_str("*** OFFSCHED LOG ***");
+	offsched_log_bytes = bytes;
+
+	pr_info("offsched: %lu log blocks per CPU, %s when full\n", nr_blocks,
+		offsched_log_stop ? "stop" : "overwrite");
 }
 
-int offsched_log_str(const char *str)
+static inline u8 *offsched_log_varint(u8 *p, u64 val)
 {
-	int i;
+	while (val >= 0x80) {
+		*p++ = val | 0x80;
+		val >>= 7;
+	}
+	*p++ = val;
+
+	return p;
+}
 
-	for (i = 0; log.pos + i < DATA_SIZE; i++) {
-		log.data[log.pos + i] = str[i];
+/*
+ * Start the next block, at @tsc. A reader that sees seq 0, or the seq of
+ * another position, skips the block.
+ */
+static struct offsched_log_block *
+offsched_log_next_block(struct offsched_log_cpu *log, u64 tsc)
+{
+	struct offsched_log_index *index = log->index;
+	struct offsched_log_block *block;
+	u64 head = index->head;
 
-		if (str[i] == 0)
-			break;
+	if (offsched_log_stop && head - READ_ONCE(
+	    offsched_log_consumer(index)->tail) >= index->nr_blocks) {
+		WRITE_ONCE(index->lost, index->lost + 1);
+		return NULL;
 	}
 
-	log.pos += i;
+	block = offsched_log_block(index, head & (index->nr_blocks - 1));
 
-	return i;
+	WRITE_ONCE(block->seq, 0);
+	smp_wmb();
+
+	block->tsc = tsc;
+	block->len = 0;
+
+	smp_wmb();
+	WRITE_ONCE(block->seq, head + 1);
+	smp_store_release(&index->head, head + 1);
+
+	log->block = block;
+	log->tsc = tsc;
+
+	return block;
 }
-EXPORT_SYMBOL_GPL(offsched_log_str);
 
-int offsched_log_raw(void *ptr, int bytes)
+/*
+ * Log @event of task @pid with @payload on this CPU, see
+ * include/uapi/linux/offsched_log.h for the encoding. Not from NMI.
+ */
+void offsched_log_event(unsigned int event, pid_t pid, u64 payload)
 {
-	int i;
-	char *raw = (char *) ptr;
+	struct offsched_log_cpu *log;
+	struct offsched_log_block *block;
+	unsigned long flags;
+	u32 len;
+	u64 tsc;
+	u8 *p;
+
+	local_irq_save(flags);
 
-	for (i = 0; log.pos + i < DATA_SIZE && i < bytes; i++) {
-		log.data[log.pos + i] = raw[i];
+	log = this_cpu_ptr(&offsched_log_cpu);
+	if (!log->index)
+		goto out;
+
+	tsc = get_cycles();
+	block = log->block;
+	len = block ? block->len : 0;
+
+	if (!block || len > OFFSCHED_LOG_BLOCK_DATA - OFFSCHED_LOG_REC_MAX) {
+		block = offsched_log_next_block(log, tsc);
+		if (!block)
+			goto out;
+		len = 0;
 	}
 
-	log.pos += i;
+	p = block->data + len;
+	p = offsched_log_varint(p, event);
+	p = offsched_log_varint(p, tsc - log->tsc);
+	p = offsched_log_varint(p, (u32)pid);
+	p = offsched_log_varint(p, payload);
+	log->tsc = tsc;
 
-	return i;
+	/* Readers copy up to len, publish the bytes first */
+	smp_store_release(&block->len, p - block->data);
+out:
+	local_irq_restore(flags);
 }
-EXPORT_SYMBOL_GPL(offsched_log_raw);
+EXPORT_SYMBOL_GPL(offsched_log_event);
+
+static void offsched_log_update_keys(void)
+{
+	int event;
+
+	for (event = 0; event < OFFSCHED_LOG_NR_EVENTS; event++) {
+		if (offsched_log_mask & BIT(event))
+			static_branch_enable(&offsched_log_keys[event]);
+		else
+			static_branch_disable(&offsched_log_keys[event]);
+	}
+}
+
+unsigned long offsched_log_events(void)
+{
+	return READ_ONCE(offsched_log_mask);
+}
+EXPORT_SYMBOL_GPL(offsched_log_events);
+
+/*
+ * Log the events of @mask from now on, and only those. Before the jump
+ * labels are initialized this only records the mask.
+ */
+int offsched_log_set_events(unsigned long mask)
+{
+	if (mask & ~OFFSCHED_LOG_EVENTS_ALL)
+		return -EINVAL;
+	if (mask && !offsched_log_bytes)
+		return -ENODEV;
+
+	mutex_lock(&offsched_log_mutex);
+	WRITE_ONCE(offsched_log_mask, mask);
+	if (offsched_log_keys_ready)
+		offsched_log_update_keys();
+	mutex_unlock(&offsched_log_mutex);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(offsched_log_set_events);
+
+static int __init offsched_log_keys_init(void)
+{
+	mutex_lock(&offsched_log_mutex);
+	offsched_log_keys_ready = true;
+	offsched_log_update_keys();
+	mutex_unlock(&offsched_log_mutex);
+
+	return 0;
+}
+early_initcall(offsched_log_keys_init);
+
+static int offsched_log_events_set(const char *val,
+				   const struct kernel_param *kp)
+{
+	unsigned long mask;
+	int ret;
+
+	ret = kstrtoul(val, 0, &mask);
+	if (ret)
+		return ret;
+
+	return offsched_log_set_events(mask);
+}
+
+static int offsched_log_events_get(char *buffer,
+				   const struct kernel_param *kp)
+{
+	return sprintf(buffer, "%#lx\n", offsched_log_events());
+}
+
+static const struct kernel_param_ops offsched_log_events_ops = {
+	.set	= offsched_log_events_set,
+	.get	= offsched_log_events_get,
+};
+module_param_cb(events, &offsched_log_events_ops, NULL, 0);
+
+/*
+ * A mapping stays within the ring of one CPU. Only the consumer page may be
+ * mapped writable, and on its own: the kernel trusts nothing but the tail
+ * from userspace.
+ */
+static int offsched_log_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	unsigned long pages = offsched_log_bytes >> PAGE_SHIFT;
+	unsigned long len = vma->vm_end - vma->vm_start;
+	struct offsched_log_index *index;
+	unsigned long cpu, pgoff;
+
+	if (!(vma->vm_flags & VM_SHARED))
+		return -EINVAL;
+
+	cpu = vma->vm_pgoff / pages;
+	pgoff = vma->vm_pgoff % pages;
+	if (cpu >= nr_cpu_ids || len > (pages - pgoff) << PAGE_SHIFT)
+		return -EINVAL;
+
+	index = per_cpu(offsched_log_cpu, cpu).index;
+	if (!index)
+		return -ENODEV;
+
+	if (vma->vm_flags & VM_WRITE) {
+		if (pgoff != 1 || len != PAGE_SIZE)
+			return -EPERM;
+	} else {
+		vma->vm_flags &= ~VM_MAYWRITE;
+	}
+
+	vma->vm_flags |= VM_DONTEXPAND | VM_DONTDUMP;
+
+	return remap_pfn_range(vma, vma->vm_start,
+			       (virt_to_phys(index) >> PAGE_SHIFT) + pgoff,
+			       len, vma->vm_page_prot);
+}
+
+static const struct file_operations offsched_log_fops = {
+	.owner		= THIS_MODULE,
+	.open		= nonseekable_open,
+	.mmap		= offsched_log_mmap,
+	.llseek		= no_llseek,
+};
+
+static struct miscdevice offsched_log_dev = {
+	.minor		= MISC_DYNAMIC_MINOR,
+	.name		= "offsched_log",
+	.fops		= &offsched_log_fops,
+	.mode		= 0600,
+};
 
-void offsched_log_nl(void)
+static int __init offsched_log_dev_init(void)
 {
-	int tmp;
+	if (!offsched_log_bytes)
+		return 0;
 
-	tmp = (log.pos - 4) % 0x10;
-	if (tmp)
-		log.pos += 0x10 - tmp;
+	return misc_register(&offsched_log_dev);
 }
-EXPORT_SYMBOL_GPL(offsched_log_nl);
+device_initcall(offsched_log_dev_init);
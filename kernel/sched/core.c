@@ -43,21 +43,12 @@
 #include <linux/offsched.h>
 #include <linux/offsched_log.h>
 #define offsched_condition(cpu) (cpu_offsched(cpu))
-#define __offsched_raw(cpu, str, raw) \
+#define __offsched_log(cpu, event, pid, payload) \
 	do { \
-		if (unlikely(offsched_condition(cpu))) { \
-			offsched_log_str(str); \
-			offsched_log_raw(&raw, sizeof(raw)); \
-			offsched_log_nl(); \
-		} \
+		if (offsched_log_enabled(event) && \
+		    unlikely(offsched_condition(cpu))) \
+			offsched_log_event(event, pid, payload); \
 	} while (0)
-#define __offsched_log(cpu, str) \
-	do \
-		if (unlikely(offsched_condition(cpu))) { \
-			offsched_log_str(str); \
-			offsched_log_nl(); \
-		} \
-	while (0)
 
 #define CREATE_TRACE_POINTS
 #include <trace/events/sched.h>
@@ -980,7 +971,11 @@ struct migration_arg {
 static struct rq *__migrate_task(struct rq *rq, struct rq_flags *rf,
 				 struct task_struct *p, int dest_cpu)
 {
-	if (p->flags & PF_KTHREAD) {
+	if (cpu_offsched(dest_cpu)) {
+		/* OFFSCHED: only offsched tasks go to an offsched CPU */
+		if (unlikely(p->sched_class != &offsched_sched_class))
+			return rq;
+	} else if (p->flags & PF_KTHREAD) {
 		if (unlikely(!cpu_online(dest_cpu)))
 			return rq;
 	} else {
@@ -1121,7 +1116,10 @@ static int __set_cpus_allowed_ptr(struct task_struct *p,
 	if (cpumask_equal(&p->cpus_allowed, new_mask))
 		goto out;
 
-	if (!cpumask_intersects(new_mask, cpu_valid_mask)) {
+	/* OFFSCHED: offsched tasks may be confined to offsched CPUs */
+	if (!cpumask_intersects(new_mask, cpu_valid_mask) &&
+	    !(p->sched_class == &offsched_sched_class &&
+	      cpumask_intersects(new_mask, cpu_offsched_mask))) {
 		ret = -EINVAL;
 		goto out;
 	}
@@ -1142,7 +1140,18 @@ static int __set_cpus_allowed_ptr(struct task_struct *p,
 	if (cpumask_test_cpu(task_cpu(p), new_mask))
 		goto out;
 
-	dest_cpu = cpumask_any_and(cpu_valid_mask, new_mask);
+	dest_cpu = nr_cpu_ids;
+	if (p->sched_class == &offsched_sched_class) {
+		/*
+		 * OFFSCHED: an offsched CPU has no stopper to push its tasks,
+		 * set_cpus_allowed_offsched() had it push them itself.
+		 */
+		if (cpu_offsched(task_cpu(p)))
+			goto out;
+		dest_cpu = offsched_select_cpu(p);
+	}
+	if (dest_cpu >= nr_cpu_ids)
+		dest_cpu = cpumask_any_and(cpu_valid_mask, new_mask);
 	if (task_running(rq, p) || p->state == TASK_WAKING) {
 		struct migration_arg arg = { p, dest_cpu };
 		/* Need help from migration thread: drop lock and wait. */
@@ -1169,6 +1178,103 @@ int set_cpus_allowed_ptr(struct task_struct *p, const struct cpumask *new_mask)
 }
 EXPORT_SYMBOL_GPL(set_cpus_allowed_ptr);
 
+struct offsched_place_arg {
+	struct cpu_stop_work work;
+	struct migration_arg arg;
+};
+
+static int offsched_place_stop(void *data)
+{
+	struct offsched_place_arg *place = data;
+
+	migration_cpu_stop(&place->arg);
+	put_task_struct(place->arg.task);
+	kfree(place);
+
+	return 0;
+}
+
+/*
+ * OFFSCHED: a task that switched to SCHED_OFFSCHED away from the offsched
+ * CPUs would wait there until its CPU goes offsched; move it to the CPU
+ * offsched_place_cpu() picks. A task that left SCHED_OFFSCHED goes the other
+ * way, to an online CPU. Like the tail of __set_cpus_allowed_ptr(), except
+ * that sched_setattr() calls us under rcu_read_lock(), so the stopper is not
+ * waited for.
+ *
+ * The stopper of an offsched CPU is parked: an offsched task there is pushed
+ * by that CPU itself, see offsched_push_task(). Returns -ENOMEM, or -EBUSY,
+ * if a task running elsewhere could not be handed to the stopper; its EDF
+ * bandwidth then goes back to @edf_cpu, where it was charged before the call.
+ */
+static int offsched_place_task(struct task_struct *p,
+			       const struct sched_attr *attr, int edf_cpu)
+{
+	struct offsched_place_arg *place;
+	struct rq_flags rf;
+	struct rq *rq;
+	int dest_cpu, ret = 0;
+
+	rq = task_rq_lock(p, &rf);
+
+	if (p->sched_class == &offsched_sched_class) {
+		dest_cpu = offsched_place_cpu(p, attr);
+	} else {
+		p->offsched.push_cpu = -1;
+		if (cpu_online(task_cpu(p)))
+			goto out;
+		dest_cpu = select_fallback_rq(task_cpu(p), p);
+	}
+
+	if (dest_cpu < 0 || dest_cpu == task_cpu(p))
+		goto out;
+
+	update_rq_clock(rq);
+
+	if (p->sched_class == &offsched_sched_class) {
+		/* Also where select_task_rq_offsched() sends it on wakeup */
+		offsched_push_task(rq, p, dest_cpu);
+		if (cpu_offsched(cpu_of(rq)))
+			goto out;
+	}
+
+	if (task_running(rq, p) || p->state == TASK_WAKING) {
+		place = kmalloc(sizeof(*place), GFP_ATOMIC);
+		if (!place) {
+			ret = -ENOMEM;
+			goto fail;
+		}
+
+		get_task_struct(p);
+		place->arg.task = p;
+		place->arg.dest_cpu = dest_cpu;
+		task_rq_unlock(rq, p, &rf);
+
+		if (stop_one_cpu_nowait(cpu_of(rq), offsched_place_stop,
+					place, &place->work))
+			return 0;
+
+		put_task_struct(p);
+		kfree(place);
+
+		rq = task_rq_lock(p, &rf);
+		ret = -EBUSY;
+		goto fail;
+	} else if (task_on_rq_queued(p)) {
+		rq = move_queued_task(rq, &rf, p, dest_cpu);
+	}
+	/* A blocked task is placed by select_task_rq() on wakeup */
+out:
+	task_rq_unlock(rq, p, &rf);
+	return 0;
+
+fail:
+	p->offsched.push_cpu = -1;
+	offsched_edf_unplace(p, edf_cpu);
+	task_rq_unlock(rq, p, &rf);
+	return ret;
+}
+
 void set_task_cpu(struct task_struct *p, unsigned int new_cpu)
 {
 #ifdef CONFIG_SCHED_DEBUG
@@ -1204,8 +1310,11 @@ void set_task_cpu(struct task_struct *p, unsigned int new_cpu)
 #endif
 	/*
 	 * Clearly, migrating tasks to offline CPUs is a fairly daft thing.
+	 * OFFSCHED: unless the CPU runs them offline.
 	 */
-	WARN_ON_ONCE(!cpu_online(new_cpu));
+	WARN_ON_ONCE(!cpu_online(new_cpu) &&
+		     !(cpu_offsched(new_cpu) &&
+		       p->sched_class == &offsched_sched_class));
 #endif
 
 	trace_sched_migrate_task(p, new_cpu);
@@ -1587,9 +1696,12 @@ int select_task_rq(struct task_struct *p, int cpu, int sd_flags, int wake_flags)
 	 *   not worry about this generic constraint ]
 	 */
 	offsched_flag = cpu_offsched(cpu) &&
-		p->sched_class == &offsched_sched_class;
+		p->sched_class == &offsched_sched_class &&
+		READ_ONCE(cpu_rq(cpu)->offsched.active);
 	if (unlikely(!cpumask_test_cpu(cpu, &p->cpus_allowed) ||
 			!(cpu_online(cpu) || offsched_flag))) {
+		if (p->sched_class == &offsched_sched_class)
+			offsched_wake_fallback(p);
 		cpu = select_fallback_rq(task_cpu(p), p);
 	}
 
@@ -1640,6 +1752,13 @@ static inline int __set_cpus_allowed_ptr(struct task_struct *p,
 	return set_cpus_allowed_ptr(p, new_mask);
 }
 
+static inline int offsched_place_task(struct task_struct *p,
+				      const struct sched_attr *attr,
+				      int edf_cpu)
+{
+	return 0;
+}
+
 #endif /* CONFIG_SMP */
 
 static void
@@ -1790,6 +1909,106 @@ void sched_ttwu_pending(void)
 	rq_unlock_irqrestore(rq, &rf);
 }
 
+/*
+ * OFFSCHED: offsched CPUs poll for work, so waking a task there takes no
+ * remote rq lock and sends no IPI, unless offsched_wakeup_kick() asks for one.
+ * The task goes on the lock-free offsched wake list and the doorbell is
+ * rung if the list was empty; the offsched CPU activates the whole batch
+ * under its own lock, see offsched_ttwu_pending().
+ *
+ * Returns false, queueing nothing, if the CPU is not an active offsched
+ * CPU (any more). offsched_end() waits for nr_wakers to drop before its
+ * last look at the wake_list, so a task queued here is never left there.
+ */
+static bool ttwu_queue_offsched(struct task_struct *p, int cpu, int wake_flags)
+{
+	struct rq *rq = cpu_rq(cpu);
+	bool queued = false;
+
+	atomic_inc(&rq->offsched.nr_wakers);
+	smp_mb__after_atomic();
+
+	if (READ_ONCE(rq->offsched.active)) {
+		p->sched_remote_wakeup = !!(wake_flags & WF_MIGRATED);
+
+		if (llist_add(&p->wake_entry, &rq->offsched.wake_list)) {
+			offsched_ring_doorbell(rq);
+			if (offsched_wakeup_kick(rq, p))
+				smp_send_reschedule(cpu);
+		}
+		queued = true;
+	}
+
+	smp_mb__before_atomic();
+	atomic_dec(&rq->offsched.nr_wakers);
+
+	return queued;
+}
+
+/*
+ * Called on the offsched CPU with its rq lock held and the clock updated.
+ */
+void offsched_ttwu_pending(struct rq *rq, struct rq_flags *rf)
+{
+	struct llist_node *llist = llist_del_all(&rq->offsched.wake_list);
+	struct task_struct *p, *t;
+
+	lockdep_assert_held(&rq->lock);
+
+	if (!llist)
+		return;
+
+	/* llist is LIFO, activate in wakeup order */
+	llist = llist_reverse_order(llist);
+
+	llist_for_each_entry_safe(p, t, llist, wake_entry) {
+		__offsched_log(cpu_of(rq), OFFSCHED_LOG_WAKEUP, p->pid,
+			       p->sched_remote_wakeup);
+		ttwu_do_activate(rq, p, p->sched_remote_wakeup ? WF_MIGRATED : 0, rf);
+	}
+}
+
+/*
+ * OFFSCHED: scheduler_ipi() of an offsched CPU. A remote waker interrupts
+ * the running task for a wakeup that may preempt it: activate the wake_list
+ * here so that check_preempt_curr() gets to set need_resched.
+ */
+void offsched_ttwu_ipi(void)
+{
+	struct rq *rq = this_rq();
+	struct rq_flags rf;
+
+	if (llist_empty(&rq->offsched.wake_list))
+		return;
+
+	rq_lock(rq, &rf);
+	update_rq_clock(rq);
+	offsched_ttwu_pending(rq, &rf);
+	rq_unlock(rq, &rf);
+}
+
+/*
+ * OFFSCHED: @p is bound to the offsched CPU we run on, typically one offsched
+ * task handing work to another. It can't be running here while we are and
+ * stays on this CPU, so try_to_wake_up() neither waits for ->on_cpu nor
+ * selects a CPU, and ttwu_queue() activates it under the local rq lock.
+ */
+static inline bool ttwu_offsched_local(struct task_struct *p)
+{
+	int cpu = smp_processor_id();
+
+	/*
+	 * Not once offsched_end() cleared active: the task would be stranded
+	 * here. try_to_wake_up() has interrupts off, so it can't clear it
+	 * under us.
+	 */
+	return cpu_offsched(cpu) && READ_ONCE(cpu_rq(cpu)->offsched.active) &&
+		task_cpu(p) == cpu &&
+		p->sched_class == &offsched_sched_class &&
+		READ_ONCE(p->offsched.cpu) == cpu &&
+		cpumask_test_cpu(cpu, &p->cpus_allowed);
+}
+
 void scheduler_ipi(void)
 {
 	/*
@@ -1799,6 +2018,15 @@ void scheduler_ipi(void)
 	 */
 	preempt_fold_need_resched();
 
+	/*
+	 * OFFSCHED: the slice timer of an offsched CPU raises this vector, and
+	 * so do remote wakers asking for wakeup preemption.
+	 */
+	if (cpu_offsched(smp_processor_id())) {
+		offsched_ttwu_ipi();
+		offsched_slice_expired();
+	}
+
 	if (llist_empty(&this_rq()->wake_list) && !got_nohz_idle_kick())
 		return;
 
@@ -1878,6 +2106,24 @@ static void ttwu_queue(struct task_struct *p, int cpu, int wake_flags)
 	struct rq_flags rf;
 
 #if defined(CONFIG_SMP)
+	/*
+	 * OFFSCHED: select_task_rq() only returns an offline CPU for an
+	 * offsched task if it is offsched, but it may have left since: select
+	 * again, another offsched CPU or an online one.
+	 */
+	while (!cpu_online(cpu) && cpu != smp_processor_id() &&
+	       p->sched_class == &offsched_sched_class) {
+		if (ttwu_queue_offsched(p, cpu, wake_flags))
+			return;
+
+		cpu = select_task_rq(p, cpu, SD_BALANCE_WAKE, wake_flags);
+		if (task_cpu(p) != cpu) {
+			set_task_cpu(p, cpu);
+			wake_flags |= WF_MIGRATED;
+		}
+		rq = cpu_rq(cpu);
+	}
+
 	if (sched_feat(TTWU_QUEUE) && !cpus_share_cache(smp_processor_id(), cpu)) {
 		sched_clock_cpu(cpu); /* Sync clocks across CPUs */
 		ttwu_queue_remote(p, cpu, wake_flags);
@@ -2003,6 +2249,9 @@ try_to_wake_up(struct task_struct *p, unsigned int state, int wake_flags)
 {
 	unsigned long flags;
 	int cpu, success = 0;
+#ifdef CONFIG_SMP
+	bool offsched_local;
+#endif
 
 	/*
 	 * If we are going to wake up a thread waiting for CONDITION we
@@ -2066,6 +2315,9 @@ try_to_wake_up(struct task_struct *p, unsigned int state, int wake_flags)
 	 */
 	smp_rmb();
 
+	/* OFFSCHED: fast path for wakeups within an offsched CPU */
+	offsched_local = ttwu_offsched_local(p);
+
 	/*
 	 * If the owning (remote) CPU is still in the middle of schedule() with
 	 * this task as prev, wait until its done referencing the task.
@@ -2075,7 +2327,8 @@ try_to_wake_up(struct task_struct *p, unsigned int state, int wake_flags)
 	 * This ensures that tasks getting woken will be fully ordered against
 	 * their previous state and preserve Program Order.
 	 */
-	smp_cond_load_acquire(&p->on_cpu, !VAL);
+	if (!offsched_local)
+		smp_cond_load_acquire(&p->on_cpu, !VAL);
 
 	p->sched_contributes_to_load = !!task_contributes_to_load(p);
 	p->state = TASK_WAKING;
@@ -2085,10 +2338,12 @@ try_to_wake_up(struct task_struct *p, unsigned int state, int wake_flags)
 		atomic_dec(&task_rq(p)->nr_iowait);
 	}
 
-	cpu = select_task_rq(p, p->wake_cpu, SD_BALANCE_WAKE, wake_flags);
-	if (task_cpu(p) != cpu) {
-		wake_flags |= WF_MIGRATED;
-		set_task_cpu(p, cpu);
+	if (!offsched_local) {
+		cpu = select_task_rq(p, p->wake_cpu, SD_BALANCE_WAKE, wake_flags);
+		if (task_cpu(p) != cpu) {
+			wake_flags |= WF_MIGRATED;
+			set_task_cpu(p, cpu);
+		}
 	}
 
 	if (unlikely(offsched_condition(cpu) && p->sched_class != &offsched_sched_class))
@@ -2224,6 +2479,13 @@ static void __sched_fork(unsigned long clone_flags, struct task_struct *p)
 	p->rt.on_list		= 0;
 
 	p->offsched.cpu = -1;
+	RB_CLEAR_NODE(&p->offsched.rb_node);
+	/* EDF reservations belong to the task, they don't survive fork */
+	p->offsched.flags &= ~SCHED_FLAG_OFFSCHED_EDF;
+	p->offsched.dl_bw = 0;
+	p->offsched.edf_cpu = -1;
+	p->offsched.drained = false;
+	p->offsched.push_cpu = -1;
 
 #ifdef CONFIG_PREEMPT_NOTIFIERS
 	INIT_HLIST_HEAD(&p->preempt_notifiers);
@@ -3995,6 +4257,8 @@ static void __setscheduler_params(struct task_struct *p,
 
 	if (dl_policy(policy))
 		__setparam_dl(p, attr);
+	else if (offsched_policy(policy))
+		__setparam_offsched(p, attr);
 	else if (fair_policy(policy))
 		p->static_prio = NICE_TO_PRIO(attr->sched_nice);
 
@@ -4061,6 +4325,7 @@ static int __sched_setscheduler(struct task_struct *p,
 	struct rq_flags rf;
 	int reset_on_fork;
 	int queue_flags = DEQUEUE_SAVE | DEQUEUE_MOVE | DEQUEUE_NOCLOCK;
+	int edf_cpu;
 	struct rq *rq;
 
 	/* The pi code expects interrupts enabled */
@@ -4078,7 +4343,12 @@ recheck:
 	}
 
 	if (attr->sched_flags &
-		~(SCHED_FLAG_RESET_ON_FORK | SCHED_FLAG_RECLAIM))
+		~(SCHED_FLAG_RESET_ON_FORK | SCHED_FLAG_RECLAIM |
+		  SCHED_FLAG_OFFSCHED_ALL))
+		return -EINVAL;
+
+	if (!offsched_policy(policy) &&
+	    (attr->sched_flags & SCHED_FLAG_OFFSCHED_ALL))
 		return -EINVAL;
 
 	/*
@@ -4090,7 +4360,13 @@ recheck:
 	    (!p->mm && attr->sched_priority > MAX_RT_PRIO-1))
 		return -EINVAL;
 	if ((dl_policy(policy) && !__checkparam_dl(attr)) ||
-	    (rt_policy(policy) != (attr->sched_priority != 0)))
+	    (offsched_policy(policy) && !__checkparam_offsched(attr)) ||
+	    (!offsched_policy(policy) &&
+	     rt_policy(policy) != (attr->sched_priority != 0)))
+		return -EINVAL;
+	if (offsched_policy(policy) &&
+	    (attr->sched_flags & SCHED_FLAG_OFFSCHED_CPU) &&
+	    !cpumask_test_cpu(attr->sched_offsched_cpu, &p->cpus_allowed))
 		return -EINVAL;
 
 	/*
@@ -4126,6 +4402,25 @@ recheck:
 		if (dl_policy(policy))
 			return -EPERM;
 
+		/*
+		 * OFFSCHED: the priorities follow RLIMIT_RTPRIO like the rt
+		 * policies, and EDF reserves bandwidth like SCHED_DEADLINE.
+		 */
+		if (offsched_policy(policy)) {
+			unsigned long rlim_rtprio =
+					task_rlimit(p, RLIMIT_RTPRIO);
+
+			if (attr->sched_flags & SCHED_FLAG_OFFSCHED_EDF)
+				return -EPERM;
+
+			if (policy != p->policy && !rlim_rtprio)
+				return -EPERM;
+
+			if (attr->sched_priority > p->rt_priority &&
+			    attr->sched_priority > rlim_rtprio)
+				return -EPERM;
+		}
+
 		/*
 		 * Treat SCHED_IDLE as nice 20. Only allow a switch to
 		 * SCHED_NORMAL if the RLIMIT_NICE would normally permit it.
@@ -4179,6 +4474,8 @@ recheck:
 			goto change;
 		if (dl_policy(policy) && dl_param_changed(p, attr))
 			goto change;
+		if (offsched_policy(policy) && offsched_param_changed(p, attr))
+			goto change;
 
 		p->sched_reset_on_fork = reset_on_fork;
 		task_rq_unlock(rq, p, &rf);
@@ -4234,6 +4531,14 @@ change:
 		return -EBUSY;
 	}
 
+	/* OFFSCHED: same for the EDF mode, per offsched CPU */
+	edf_cpu = p->offsched.edf_cpu;
+	if ((offsched_policy(policy) || task_has_offsched_policy(p)) &&
+	    offsched_edf_overflow(p, policy, attr)) {
+		task_rq_unlock(rq, p, &rf);
+		return -EBUSY;
+	}
+
 	p->sched_reset_on_fork = reset_on_fork;
 	oldprio = p->prio;
 
@@ -4286,6 +4591,12 @@ change:
 	balance_callback(rq);
 	preempt_enable();
 
+	/* OFFSCHED: move tasks onto, between and off the offsched CPUs */
+	if ((prev_class == &offsched_sched_class) !=
+	    (p->sched_class == &offsched_sched_class) ||
+	    (attr->sched_flags & SCHED_FLAG_OFFSCHED_CPU))
+		return offsched_place_task(p, attr, edf_cpu);
+
 	return 0;
 }
 
@@ -4558,7 +4869,7 @@ SYSCALL_DEFINE2(sched_getparam, pid_t, pid, struct sched_param __user *, param)
 	if (retval)
 		goto out_unlock;
 
-	if (task_has_rt_policy(p))
+	if (task_has_rt_policy(p) || task_has_offsched_policy(p))
 		lp.sched_priority = p->rt_priority;
 	rcu_read_unlock();
 
@@ -4645,6 +4956,8 @@ SYSCALL_DEFINE4(sched_getattr, pid_t, pid, struct sched_attr __user *, uattr,
 		attr.sched_flags |= SCHED_FLAG_RESET_ON_FORK;
 	if (task_has_dl_policy(p))
 		__getparam_dl(p, &attr);
+	else if (task_has_offsched_policy(p))
+		__getparam_offsched(p, &attr);
 	else if (task_has_rt_policy(p))
 		attr.sched_priority = p->rt_priority;
 	else
@@ -4660,6 +4973,18 @@ out_unlock:
 	return retval;
 }
 
+/*
+ * OFFSCHED: cpusets only know about online CPUs, SCHED_OFFSCHED tasks may
+ * also be given any offsched CPU.
+ */
+static void offsched_cpuset_cpus_allowed(struct task_struct *p,
+					 struct cpumask *mask)
+{
+	cpuset_cpus_allowed(p, mask);
+	if (task_has_offsched_policy(p))
+		cpumask_or(mask, mask, cpu_offsched_mask);
+}
+
 long sched_setaffinity(pid_t pid, const struct cpumask *in_mask)
 {
 	cpumask_var_t cpus_allowed, new_mask;
@@ -4705,7 +5030,7 @@ long sched_setaffinity(pid_t pid, const struct cpumask *in_mask)
 		goto out_free_new_mask;
 
 
-	cpuset_cpus_allowed(p, cpus_allowed);
+	offsched_cpuset_cpus_allowed(p, cpus_allowed);
 	cpumask_and(new_mask, in_mask, cpus_allowed);
 
 	/*
@@ -4729,7 +5054,7 @@ again:
 	retval = __set_cpus_allowed_ptr(p, new_mask, true);
 
 	if (!retval) {
-		cpuset_cpus_allowed(p, cpus_allowed);
+		offsched_cpuset_cpus_allowed(p, cpus_allowed);
 		if (!cpumask_subset(new_mask, cpus_allowed)) {
 			/*
 			 * We must have raced with a concurrent cpuset
@@ -4868,6 +5193,12 @@ SYSCALL_DEFINE0(sched_yield)
 	schedstat_inc(rq->yld_count);
 	current->sched_class->yield_task(rq);
 
+	/* OFFSCHED: cooperative loops yield a lot, skip __schedule() if alone */
+	if (offsched_yield_alone(rq)) {
+		rq_unlock_irq(rq, &rf);
+		return 0;
+	}
+
 	/*
 	 * Since we are going to call schedule() anyway, there's
 	 * no need to preempt or enable interrupts:
@@ -5098,6 +5429,9 @@ SYSCALL_DEFINE1(sched_get_priority_max, int, policy)
 	case SCHED_RR:
 		ret = MAX_USER_RT_PRIO-1;
 		break;
+	case SCHED_OFFSCHED:
+		ret = MAX_OFFSCHED_PRIO-1;
+		break;
 	case SCHED_DEADLINE:
 	case SCHED_NORMAL:
 	case SCHED_BATCH:
@@ -5129,6 +5463,7 @@ SYSCALL_DEFINE1(sched_get_priority_min, int, policy)
 	case SCHED_NORMAL:
 	case SCHED_BATCH:
 	case SCHED_IDLE:
+	case SCHED_OFFSCHED:
 		ret = 0;
 	}
 	return ret;
@@ -4,32 +4,397 @@
 
 #include <linux/smp.h>
 #include <linux/printk.h>
+#include <linux/moduleparam.h>
+#include <linux/offsched.h>
 #include <linux/offsched_log.h>
-#include <linux/jiffies.h>
 #include <linux/kernel_stat.h>
 #include <linux/rcupdate.h>
+#include <linux/workqueue.h>
+#include <linux/sched/isolation.h>
 
 #include "sched.h"
 
-#define __offsched_raw(str, raw) \
-	do { \
-		offsched_log_str(str); \
-		offsched_log_raw(&raw, sizeof(raw)); \
-		offsched_log_nl(); \
-	} while (0)
-#define __offsched_log(str) \
-	do { \
-		offsched_log_str(str); \
-		offsched_log_nl(); \
-	} while (0)
+#define CREATE_TRACE_POINTS
+#include <trace/events/offsched.h>
+
+/*
+ * Tunables, read locklessly; /sys/kernel/offsched/ changes them at runtime,
+ * see offsched_sysfs.c, and offsched.<name>= on the command line at boot.
+ *
+ * Idle engine policy: offsched_idle() polls the runqueue for idle_poll_ns,
+ * then arms MONITOR/MWAIT on the doorbell with idle_mwait_hint (0 is C1,
+ * the cheapest state to leave). idle_mwait=0 keeps polling forever.
+ *
+ * Default slice for tasks which didn't ask for one with sched_runtime,
+ * timeslice_ns=0 keeps them cooperative.
+ *
+ * EDF admission control: the admitted bandwidth of each offsched CPU may
+ * not exceed edf_max_util percent of it.
+ *
+ * Work stealing: with steal, an offsched CPU waiting in offsched_idle()
+ * pulls queued tasks from a busier offsched sibling.
+ *
+ * Wakeup preemption of the running offsched task, OFFSCHED_PREEMPT_*.
+ *
+ * exit_revert: tasks offsched_end() finds no other offsched CPU for go
+ * back to SCHED_NORMAL, or wait on an online CPU for one otherwise.
+ */
+struct offsched_tunables offsched_tunables __read_mostly ____cacheline_aligned = {
+	.idle_poll_ns		= 20000,
+	.idle_mwait		= true,
+	.idle_mwait_hint	= 0,
+	.timeslice_ns		= 0,
+	.edf_max_util		= 95,
+	.steal			= false,
+	.wakeup_preempt		= OFFSCHED_PREEMPT_NONE,
+	.exit_revert		= true,
+};
+
+/*
+ * Parse @buf into the tunable of @t. Out of bounds values are rejected,
+ * leaving the tunable as it was. Used by the offsched.* boot parameters
+ * and /sys/kernel/offsched/, see offsched_sysfs.c.
+ */
+int offsched_tunable_set_uint(struct offsched_tunable_uint *t, const char *buf)
+{
+	unsigned int val;
+	int ret;
+
+	ret = kstrtouint(buf, 0, &val);
+	if (ret)
+		return ret;
+
+	if (!(t->off && !val) && (val < t->min || val > t->max))
+		return -EINVAL;
+
+	WRITE_ONCE(*t->val, val);
+	return 0;
+}
+
+static int offsched_tunable_param_set(const char *val,
+				      const struct kernel_param *kp)
+{
+	return offsched_tunable_set_uint(kp->arg, val);
+}
+
+static int offsched_tunable_param_get(char *buffer,
+				      const struct kernel_param *kp)
+{
+	struct offsched_tunable_uint *t = kp->arg;
+
+	return sprintf(buffer, "%u\n", READ_ONCE(*t->val));
+}
+
+static const struct kernel_param_ops offsched_tunable_uint_ops = {
+	.set	= offsched_tunable_param_set,
+	.get	= offsched_tunable_param_get,
+};
+
+#define OFFSCHED_TUNABLE_UINT(_name, _min, _max, _off)			\
+struct offsched_tunable_uint offsched_tunable_##_name = {		\
+	.val	= &offsched_tunables._name,				\
+	.min	= (_min),						\
+	.max	= (_max),						\
+	.off	= (_off),						\
+};									\
+module_param_cb(_name, &offsched_tunable_uint_ops,			\
+		&offsched_tunable_##_name, 0)
+
+OFFSCHED_TUNABLE_UINT(idle_poll_ns, 0, UINT_MAX, false);
+OFFSCHED_TUNABLE_UINT(idle_mwait_hint, 0, 0xff, false);
+/* Same as a per-task slice, see __checkparam_offsched() */
+OFFSCHED_TUNABLE_UINT(timeslice_ns, OFFSCHED_MIN_SLICE_NS, UINT_MAX, true);
+OFFSCHED_TUNABLE_UINT(edf_max_util, 1, 100, false);
+OFFSCHED_TUNABLE_UINT(wakeup_preempt, OFFSCHED_PREEMPT_NONE,
+		      OFFSCHED_PREEMPT_NEXT, false);
+
+module_param_named(idle_mwait, offsched_tunables.idle_mwait, bool, 0);
+module_param_named(steal, offsched_tunables.steal, bool, 0);
+module_param_named(exit_revert, offsched_tunables.exit_revert, bool, 0);
+
+static DEFINE_RAW_SPINLOCK(offsched_edf_lock);
+
+/* Idle offsched CPUs, whom enqueuers kick for stealing */
+static struct cpumask offsched_idle_cpus;
+
+/*
+ * SCHED_FLAG_OFFSCHED_REVERT: offsched_end() marks its CPU here and leaves
+ * the policy change to offsched_revert_work, queued once the CPU is out of
+ * cpu_offsched_mask, see offsched_cpu_exited(). Wakeups look here too, see
+ * offsched_wake_fallback().
+ */
+static struct cpumask offsched_revert_pending;
+static struct cpumask offsched_reverting;
+
+static void offsched_revert_fn(struct work_struct *work);
+static DECLARE_WORK(offsched_revert_work, offsched_revert_fn);
 
 void __init init_offsched_rq(struct offsched_rq *offsched_rq)
 {
-	INIT_LIST_HEAD(&offsched_rq->head);
+	struct offsched_prio_array *array = &offsched_rq->active_array;
+	int i;
+
+	for (i = 0; i < MAX_OFFSCHED_PRIO; i++) {
+		INIT_LIST_HEAD(array->queue + i);
+		__clear_bit(i, array->bitmap);
+	}
+	/* delimiter for bitsearch: */
+	__set_bit(MAX_OFFSCHED_PRIO, array->bitmap);
+
+	offsched_rq->edf_root = RB_ROOT_CACHED;
+	offsched_rq->edf_bw = 0;
+
+	init_llist_head(&offsched_rq->wake_list);
+	atomic_set(&offsched_rq->nr_wakers, 0);
+
 	offsched_rq->nr_running = 0;
-	offsched_rq->nr_total = 0;
+	offsched_rq->nr_stealable = 0;
+	atomic_set(&offsched_rq->nr_total, 0);
 	offsched_rq->active = false;
-	offsched_rq->next = NULL;
+	offsched_rq->push_pending = false;
+	INIT_LIST_HEAD(&offsched_rq->push_list);
+	offsched_rq->slice_end = 0;
+	offsched_rq->curr_prio = MAX_OFFSCHED_PRIO;
+	offsched_rq->curr_edf = false;
+	offsched_rq->curr_deadline = 0;
+	offsched_rq->doorbell = 0;
+}
+
+static inline bool offsched_edf(struct offsched_entity *offsched)
+{
+	return offsched->flags & SCHED_FLAG_OFFSCHED_EDF;
+}
+
+/*
+ * Work stealing leaves EDF tasks, whose bandwidth is reserved on their CPU,
+ * and tasks placed on purpose alone.
+ */
+static inline bool offsched_stealable(struct offsched_entity *offsched)
+{
+	return !(offsched->flags &
+		 (SCHED_FLAG_OFFSCHED_EDF | SCHED_FLAG_OFFSCHED_CPU));
+}
+
+/*
+ * The priority itself lives in p->rt_priority, __setscheduler_params()
+ * stores sched_priority there for every policy.
+ *
+ * Without SCHED_FLAG_OFFSCHED_EDF sched_runtime is the slice of the task,
+ * with it runtime/deadline/period mean the same as for SCHED_DEADLINE.
+ * sched_offsched_cpu is only looked at by the placement, see
+ * offsched_place_cpu().
+ */
+void __setparam_offsched(struct task_struct *p, const struct sched_attr *attr)
+{
+	struct offsched_entity *offsched = &p->offsched;
+
+	offsched->flags = attr->sched_flags & SCHED_FLAG_OFFSCHED_ALL;
+
+	if (offsched_edf(offsched)) {
+		offsched->slice = 0;
+		offsched->dl_runtime = attr->sched_runtime;
+		offsched->dl_deadline = attr->sched_deadline;
+		offsched->dl_period = attr->sched_period ?: attr->sched_deadline;
+		/* Forces a fresh deadline at the next enqueue */
+		offsched->deadline = 0;
+		offsched->runtime = 0;
+	} else {
+		offsched->slice = attr->sched_runtime;
+		offsched->dl_runtime = 0;
+		offsched->dl_deadline = 0;
+		offsched->dl_period = 0;
+	}
+}
+
+void __getparam_offsched(struct task_struct *p, struct sched_attr *attr)
+{
+	struct offsched_entity *offsched = &p->offsched;
+
+	attr->sched_priority = p->rt_priority;
+	attr->sched_flags |= offsched->flags;
+
+	/* Only then, a short struct sched_attr of old userspace has no room */
+	if (offsched->flags & SCHED_FLAG_OFFSCHED_CPU)
+		attr->sched_offsched_cpu = task_cpu(p);
+
+	if (offsched_edf(offsched)) {
+		attr->sched_runtime = offsched->dl_runtime;
+		attr->sched_deadline = offsched->dl_deadline;
+		attr->sched_period = offsched->dl_period;
+	} else {
+		attr->sched_runtime = offsched->slice;
+	}
+}
+
+/*
+ * sched_runtime is the slice of the task: 0 means the default one, anything
+ * shorter than OFFSCHED_MIN_SLICE_NS would just storm the CPU with timer
+ * interrupts. The EDF parameters follow __checkparam_dl(), with the same
+ * lower bound on the runtime. A requested CPU must be an offsched one,
+ * __sched_setscheduler() checks it against the affinity of the task.
+ */
+bool __checkparam_offsched(const struct sched_attr *attr)
+{
+	if (attr->sched_priority > MAX_OFFSCHED_PRIO - 1)
+		return false;
+
+	if (attr->sched_offsched_pad)
+		return false;
+
+	if ((attr->sched_flags & SCHED_FLAG_OFFSCHED_CPU) &&
+	    (attr->sched_offsched_cpu >= nr_cpu_ids ||
+	     !cpu_offsched(attr->sched_offsched_cpu)))
+		return false;
+
+	/* MSB is used for sign in the deadline math, keep it clear */
+	if (attr->sched_runtime & (1ULL << 63) ||
+	    attr->sched_deadline & (1ULL << 63) ||
+	    attr->sched_period & (1ULL << 63))
+		return false;
+
+	if (!(attr->sched_flags & SCHED_FLAG_OFFSCHED_EDF)) {
+		if (attr->sched_deadline || attr->sched_period)
+			return false;
+
+		return !attr->sched_runtime ||
+			attr->sched_runtime >= OFFSCHED_MIN_SLICE_NS;
+	}
+
+	if (attr->sched_deadline == 0 ||
+	    attr->sched_runtime < OFFSCHED_MIN_SLICE_NS)
+		return false;
+
+	/* runtime <= deadline <= period (if period != 0) */
+	if ((attr->sched_period != 0 &&
+	     attr->sched_period < attr->sched_deadline) ||
+	    attr->sched_deadline < attr->sched_runtime)
+		return false;
+
+	return true;
+}
+
+bool offsched_param_changed(struct task_struct *p,
+	const struct sched_attr *attr)
+{
+	struct offsched_entity *offsched = &p->offsched;
+
+	if (p->rt_priority != attr->sched_priority ||
+	    offsched->flags != (attr->sched_flags & SCHED_FLAG_OFFSCHED_ALL))
+		return true;
+
+	if ((attr->sched_flags & SCHED_FLAG_OFFSCHED_CPU) &&
+	    attr->sched_offsched_cpu != task_cpu(p))
+		return true;
+
+	if (!offsched_edf(offsched))
+		return offsched->slice != attr->sched_runtime;
+
+	return offsched->dl_runtime != attr->sched_runtime ||
+		offsched->dl_deadline != attr->sched_deadline ||
+		offsched->dl_period != (attr->sched_period ?: attr->sched_deadline);
+}
+
+/*
+ * Charge (or release) the EDF bandwidth of @p against the offsched CPU it
+ * runs or is going to run on, moving the charge if it asked for another
+ * one. Returns -1 if it doesn't fit, mimicking sched_dl_overflow(). Called
+ * with p->pi_lock and the task rq lock held.
+ */
+int offsched_edf_overflow(struct task_struct *p, int policy,
+	const struct sched_attr *attr)
+{
+	struct offsched_entity *offsched = &p->offsched;
+	struct offsched_rq *offsched_rq;
+	u64 period = attr->sched_period ?: attr->sched_deadline;
+	u64 new_bw = 0, old_bw, max_bw;
+	int cpu, err = 0;
+
+	if (offsched_policy(policy) &&
+	    (attr->sched_flags & SCHED_FLAG_OFFSCHED_EDF))
+		new_bw = to_ratio(period, attr->sched_runtime);
+
+	if (!new_bw && !offsched->dl_bw)
+		return 0;
+
+	if (offsched_policy(policy) &&
+	    (attr->sched_flags & SCHED_FLAG_OFFSCHED_CPU)) {
+		cpu = attr->sched_offsched_cpu;
+	} else if (offsched->edf_cpu >= 0) {
+		cpu = offsched->edf_cpu;
+	} else if (cpu_offsched(task_cpu(p))) {
+		cpu = task_cpu(p);
+	} else {
+		/* Where offsched_place_cpu() is going to move it */
+		cpu = offsched_select_cpu(p);
+		if (cpu < 0)
+			cpu = task_cpu(p);
+	}
+
+	if (new_bw == offsched->dl_bw && cpu == offsched->edf_cpu)
+		return 0;
+
+	offsched_rq = &cpu_rq(cpu)->offsched;
+	old_bw = cpu == offsched->edf_cpu ? offsched->dl_bw : 0;
+	max_bw = (u64)READ_ONCE(offsched_tunables.edf_max_util) * BW_UNIT / 100;
+
+	raw_spin_lock(&offsched_edf_lock);
+	if (new_bw > old_bw &&
+	    offsched_rq->edf_bw - old_bw + new_bw > max_bw) {
+		err = -1;
+	} else {
+		if (offsched->edf_cpu >= 0)
+			cpu_rq(offsched->edf_cpu)->offsched.edf_bw -= offsched->dl_bw;
+		offsched_rq->edf_bw += new_bw;
+		offsched->dl_bw = new_bw;
+		offsched->edf_cpu = new_bw ? cpu : -1;
+	}
+	raw_spin_unlock(&offsched_edf_lock);
+
+	return err;
+}
+
+static void offsched_edf_release(struct task_struct *p)
+{
+	struct offsched_entity *offsched = &p->offsched;
+
+	if (offsched->edf_cpu < 0)
+		return;
+
+	raw_spin_lock(&offsched_edf_lock);
+	cpu_rq(offsched->edf_cpu)->offsched.edf_bw -= offsched->dl_bw;
+	offsched->dl_bw = 0;
+	offsched->edf_cpu = -1;
+	raw_spin_unlock(&offsched_edf_lock);
+}
+
+/*
+ * Follow @p to @cpu with its EDF bandwidth. No admission control, the task
+ * has to go where its affinity sends it.
+ */
+static void offsched_edf_move(struct task_struct *p, int cpu)
+{
+	struct offsched_entity *offsched = &p->offsched;
+
+	if (offsched->edf_cpu < 0 || offsched->edf_cpu == cpu)
+		return;
+
+	raw_spin_lock(&offsched_edf_lock);
+	cpu_rq(offsched->edf_cpu)->offsched.edf_bw -= offsched->dl_bw;
+	cpu_rq(cpu)->offsched.edf_bw += offsched->dl_bw;
+	offsched->edf_cpu = cpu;
+	raw_spin_unlock(&offsched_edf_lock);
+}
+
+/*
+ * offsched_edf_overflow() charged @p where it was to go, but it could not be
+ * moved there: give the bandwidth back to @cpu, or drop it if @p had none.
+ */
+void offsched_edf_unplace(struct task_struct *p, int cpu)
+{
+	if (cpu >= 0)
+		offsched_edf_move(p, cpu);
+	else
+		offsched_edf_release(p);
 }
 
 static inline
@@ -38,25 +403,146 @@ struct task_struct *task_of_offsched(struct offsched_entity *offsched)
 	return container_of(offsched, struct task_struct, offsched);
 }
 
+/*
+ * Queue 0 holds the highest priority (sched_priority MAX_OFFSCHED_PRIO-1).
+ */
+static inline int offsched_queue_idx(struct task_struct *p)
+{
+	return MAX_OFFSCHED_PRIO - 1 - p->rt_priority;
+}
+
+/*
+ * Same test as dl_entity_overflow(): would the remaining runtime, spent
+ * before the current deadline, exceed the reserved bandwidth?
+ */
+static bool offsched_edf_overflow_entity(struct offsched_entity *offsched,
+	u64 t)
+{
+	u64 left, right;
+
+	left = (offsched->dl_period >> DL_SCALE) *
+		(offsched->runtime >> DL_SCALE);
+	right = ((offsched->deadline - t) >> DL_SCALE) *
+		(offsched->dl_runtime >> DL_SCALE);
+
+	return dl_time_before(right, left);
+}
+
+/*
+ * CBS rule on (re)enqueue: keep the current deadline if it is still usable,
+ * otherwise start a new period now.
+ */
+static void offsched_edf_update(struct offsched_entity *offsched, u64 now)
+{
+	if (dl_time_before(offsched->deadline, now) ||
+	    offsched_edf_overflow_entity(offsched, now)) {
+		offsched->deadline = now + offsched->dl_deadline;
+		offsched->runtime = offsched->dl_runtime;
+	}
+}
+
+static void offsched_edf_enqueue(struct offsched_rq *offsched_rq,
+	struct offsched_entity *offsched)
+{
+	struct rb_node **link = &offsched_rq->edf_root.rb_root.rb_node;
+	struct rb_node *parent = NULL;
+	struct offsched_entity *entry;
+	bool leftmost = true;
+
+	while (*link) {
+		parent = *link;
+		entry = rb_entry(parent, struct offsched_entity, rb_node);
+		if (dl_time_before(offsched->deadline, entry->deadline)) {
+			link = &parent->rb_left;
+		} else {
+			link = &parent->rb_right;
+			leftmost = false;
+		}
+	}
+
+	rb_link_node(&offsched->rb_node, parent, link);
+	rb_insert_color_cached(&offsched->rb_node, &offsched_rq->edf_root,
+		leftmost);
+}
+
+static void offsched_edf_dequeue(struct offsched_rq *offsched_rq,
+	struct offsched_entity *offsched)
+{
+	rb_erase_cached(&offsched->rb_node, &offsched_rq->edf_root);
+	RB_CLEAR_NODE(&offsched->rb_node);
+}
+
+/*
+ * Budget exhausted: there is no replenishment timer on an offsched CPU, so
+ * instead of throttling postpone the deadline by whole periods (soft CBS).
+ */
+static void offsched_edf_postpone(struct offsched_rq *offsched_rq,
+	struct offsched_entity *offsched)
+{
+	bool queued = !RB_EMPTY_NODE(&offsched->rb_node);
+
+	if (queued)
+		offsched_edf_dequeue(offsched_rq, offsched);
+
+	while (offsched->runtime <= 0) {
+		offsched->deadline += offsched->dl_period;
+		offsched->runtime += offsched->dl_runtime;
+	}
+
+	if (queued)
+		offsched_edf_enqueue(offsched_rq, offsched);
+}
+
+/*
+ * Earliest deadline first, then the head of the highest non-empty queue,
+ * O(1) via the bitmap.
+ */
+static inline
+struct offsched_entity *pick_next_offsched(struct offsched_rq *offsched_rq)
+{
+	struct offsched_prio_array *array = &offsched_rq->active_array;
+	struct rb_node *left = rb_first_cached(&offsched_rq->edf_root);
+	int idx;
+
+	if (left)
+		return rb_entry(left, struct offsched_entity, rb_node);
+
+	idx = sched_find_first_bit(array->bitmap);
+	if (idx >= MAX_OFFSCHED_PRIO)
+		return NULL;
+
+	return list_first_entry(array->queue + idx,
+		struct offsched_entity, list);
+}
+
 struct task_struct *offsched_task(int cpu)
 {
-        struct rq *rq = cpu_rq(cpu);
-	struct offsched_entity *offsched = list_first_entry_or_null(
-		&rq->offsched.head, struct offsched_entity, list);
+	struct rq *rq = cpu_rq(cpu);
+	struct offsched_entity *offsched = pick_next_offsched(&rq->offsched);
 
 	return offsched ? task_of_offsched(offsched) : NULL;
 }
 EXPORT_SYMBOL_GPL(offsched_task);
 
-static inline
-struct offsched_entity *pick_next_offsched(struct offsched_rq *offsched_rq,
-	struct offsched_entity *offsched)
+/*
+ * Wake an idle offsched sibling, preferably one sharing the LLC, so it
+ * can come and steal from @rq.
+ */
+static void offsched_kick_idle(struct rq *rq)
 {
-	if (!list_is_last(&offsched->list, &offsched_rq->head))
-		return list_next_entry(offsched, list);
+	int this_cpu = cpu_of(rq), cpu, target = -1;
 
-	return list_first_entry(&offsched_rq->head,
-		struct offsched_entity, list);
+	for_each_cpu(cpu, &offsched_idle_cpus) {
+		if (cpu == this_cpu)
+			continue;
+
+		target = cpu;
+		if (cpus_share_cache(this_cpu, cpu))
+			break;
+	}
+
+	if (target >= 0)
+		offsched_ring_doorbell(cpu_rq(target));
 }
 
 static void enqueue_task_offsched(struct rq *rq, struct task_struct *p,
@@ -64,24 +550,57 @@ static void enqueue_task_offsched(struct rq *rq, struct task_struct *p,
 {
 	struct offsched_entity *offsched = &p->offsched;
 	struct offsched_rq *offsched_rq = &rq->offsched;
-
-	list_add_tail(&offsched->list, &offsched_rq->head);
+	struct offsched_prio_array *array = &offsched_rq->active_array;
+	struct list_head *queue;
+
+	if (offsched_edf(offsched)) {
+		offsched_edf_update(offsched, rq_clock(rq));
+		offsched_edf_enqueue(offsched_rq, offsched);
+	} else {
+		offsched->prio = offsched_queue_idx(p);
+		queue = array->queue + offsched->prio;
+
+		if (flags & ENQUEUE_HEAD)
+			list_add(&offsched->list, queue);
+		else
+			list_add_tail(&offsched->list, queue);
+		__set_bit(offsched->prio, array->bitmap);
+	}
 	offsched_rq->nr_running++;
+	if (offsched_stealable(offsched))
+		offsched_rq->nr_stealable++;
 
 	if (unlikely(offsched->cpu != rq->cpu)) {
+		if (offsched->cpu >= 0)
+			atomic_dec(&cpu_rq(offsched->cpu)->offsched.nr_total);
 		offsched->cpu = rq->cpu;
-		offsched->jiffies = jiffies;
 
-		offsched_rq->nr_total++;
+		atomic_inc(&offsched_rq->nr_total);
+	}
+
+	/* Arrived where sched_setattr() sent it, or woke up on the way */
+	if (unlikely(offsched->push_cpu >= 0)) {
+		if (offsched->push_cpu == rq->cpu)
+			offsched->push_cpu = -1;
+		else if (cpu_offsched(rq->cpu))
+			offsched_rq->push_pending = true;
 	}
 
 	if (offsched_rq->active)
 		add_nr_running(rq, 1);
 
-	if (offsched_rq->nr_running == 1)
-		offsched_rq->next = p;
+	if (offsched_rq->active && cpu_of(rq) != smp_processor_id())
+		offsched_ring_doorbell(rq);
+
+	if (flags & ENQUEUE_WAKEUP)
+		per_cpu(offsched_stat, cpu_of(rq)).nr_wakeups++;
 
-	__offsched_raw("OFFSCHED_C: enqueue_task(): ", p);
+	if (offsched_rq->nr_running > 1 && offsched_rq->nr_stealable &&
+	    READ_ONCE(offsched_tunables.steal))
+		offsched_kick_idle(rq);
+
+	trace_sched_offsched_enqueue(p, cpu_of(rq), offsched_rq->nr_running);
+	offsched_log(OFFSCHED_LOG_ENQUEUE, p->pid, offsched_rq->nr_running);
 }
 
 static void dequeue_task_offsched(struct rq *rq, struct task_struct *p,
@@ -89,89 +608,758 @@ static void dequeue_task_offsched(struct rq *rq, struct task_struct *p,
 {
 	struct offsched_entity *offsched = &p->offsched;
 	struct offsched_rq *offsched_rq = &rq->offsched;
-	struct offsched_entity *next_offsched;
-
-	if (offsched_rq->next == p) {
-		next_offsched = pick_next_offsched(offsched_rq, offsched);
-		offsched_rq->next = task_of_offsched(next_offsched);
+	struct offsched_prio_array *array = &offsched_rq->active_array;
+
+	if (!RB_EMPTY_NODE(&offsched->rb_node)) {
+		offsched_edf_dequeue(offsched_rq, offsched);
+	} else {
+		list_del_init(&offsched->list);
+		if (list_empty(array->queue + offsched->prio))
+			__clear_bit(offsched->prio, array->bitmap);
 	}
-
-	list_del(&offsched->list);
 	offsched_rq->nr_running--;
+	if (offsched_stealable(offsched))
+		offsched_rq->nr_stealable--;
 
 	if (offsched_rq->active)
 		sub_nr_running(rq, 1);
 
-	if (offsched_rq->nr_running == 0)
-		offsched_rq->next = NULL;
+	trace_sched_offsched_dequeue(p, cpu_of(rq), offsched_rq->nr_running);
+	offsched_log(OFFSCHED_LOG_DEQUEUE, p->pid, offsched_rq->nr_running);
+}
 
-	__offsched_raw("OFFSCHED_C: dequeue_task(): ", p);
+/*
+ * An EDF task runs until its budget is gone, the others for their slice.
+ */
+static inline u64 offsched_slice(struct task_struct *p)
+{
+	struct offsched_entity *offsched = &p->offsched;
+
+	if (offsched_edf(offsched))
+		return max_t(s64, offsched->runtime, OFFSCHED_MIN_SLICE_NS);
+
+	return offsched->slice ?: READ_ONCE(offsched_tunables.timeslice_ns);
 }
 
+/*
+ * Both must run on the offsched CPU itself, the timer is its local APIC.
+ */
+static void offsched_start_slice(struct offsched_rq *offsched_rq, u64 slice)
+{
+	if (!slice || !offsched_timer_arm(slice)) {
+		offsched_rq->slice_end = 0;
+		return;
+	}
+
+	offsched_rq->slice_end = local_clock() + slice;
+}
+
+static void offsched_stop_slice(struct offsched_rq *offsched_rq)
+{
+	if (!offsched_rq->slice_end)
+		return;
+
+	offsched_timer_cancel();
+	offsched_rq->slice_end = 0;
+}
+
+/*
+ * Called from scheduler_ipi() on an offsched CPU. Apart from the slice
+ * timer it may be a plain reschedule IPI, so the deadline is rechecked.
+ */
+void offsched_slice_expired(void)
+{
+	struct rq *rq = this_rq();
+	struct offsched_rq *offsched_rq = &rq->offsched;
+	struct task_struct *curr = rq->curr;
+	struct rq_flags rf;
+	bool again;
+	u64 now;
+
+	if (!offsched_rq->slice_end ||
+	    curr->sched_class != &offsched_sched_class)
+		return;
+
+	now = local_clock();
+	if (now < offsched_rq->slice_end) {
+		/* TSC and local_clock() rounding, wait for the rest */
+		offsched_timer_arm(offsched_rq->slice_end - now);
+		return;
+	}
+
+	/*
+	 * Still the next pick and alone at its priority: nobody to rotate to,
+	 * grant another slice. A queued EDF or higher priority task gets the
+	 * CPU whatever wakeup_preempt says. EDF budgets are always handed to
+	 * update_curr_offsched().
+	 */
+	rq_lock(rq, &rf);
+	again = !offsched_edf(&curr->offsched) &&
+		pick_next_offsched(offsched_rq) == &curr->offsched &&
+		list_is_singular(offsched_rq->active_array.queue +
+			curr->offsched.prio);
+	rq_unlock(rq, &rf);
+
+	if (again) {
+		offsched_start_slice(offsched_rq, offsched_slice(curr));
+		return;
+	}
+
+	offsched_rq->slice_end = 0;
+	set_tsk_need_resched(curr);
+	set_preempt_need_resched();
+}
+
+/*
+ * Offsched CPUs take no ticks and jiffies don't advance on them, so the
+ * runtime is charged here in nanoseconds of rq_clock_task() at every
+ * switch out (and whenever task_sched_runtime() asks for it).
+ */
+static void update_curr_offsched(struct rq *rq)
+{
+	struct task_struct *curr = rq->curr;
+	struct offsched_entity *offsched = &curr->offsched;
+	u64 now, delta_exec;
+
+	if (curr->sched_class != &offsched_sched_class)
+		return;
+
+	now = rq_clock_task(rq);
+	delta_exec = now - offsched->exec_start;
+	if (unlikely((s64)delta_exec <= 0))
+		return;
+
+	schedstat_set(curr->se.statistics.exec_max,
+		      max(curr->se.statistics.exec_max, delta_exec));
+
+	curr->se.sum_exec_runtime += delta_exec;
+	account_group_exec_runtime(curr, delta_exec);
+	account_user_time(curr, delta_exec);
+	cpuacct_charge(curr, delta_exec);
+
+	offsched->exec_start = now;
+	per_cpu(offsched_stat, cpu_of(rq)).run_ns += delta_exec;
+
+	if (offsched_edf(offsched)) {
+		offsched->runtime -= delta_exec;
+		if (offsched->runtime <= 0)
+			offsched_edf_postpone(&rq->offsched, offsched);
+	}
+}
+
+/*
+ * Go behind the other tasks of the same priority, pick_next_task_offsched()
+ * then takes the next one. An EDF task gives up the rest of its runtime
+ * and moves on to its next period instead.
+ */
 static void yield_task_offsched(struct rq *rq)
 {
+	struct task_struct *curr = rq->curr;
+	struct offsched_entity *offsched = &curr->offsched;
+	struct offsched_rq *offsched_rq = &rq->offsched;
+
+	if (offsched_edf(offsched)) {
+		update_rq_clock(rq);
+		update_curr_offsched(rq);
+		offsched->runtime = 0;
+		offsched_edf_postpone(offsched_rq, offsched);
+	} else {
+		list_move_tail(&offsched->list,
+			offsched_rq->active_array.queue + offsched->prio);
+	}
+}
+
+/*
+ * Make the queued @p the next pick among its equals. EDF tasks keep their
+ * deadline order.
+ */
+static void offsched_set_next(struct rq *rq, struct task_struct *p)
+{
+	struct offsched_entity *offsched = &p->offsched;
+
+	if (offsched_edf(offsched))
+		return;
+
+	list_move(&offsched->list,
+		rq->offsched.active_array.queue + offsched->prio);
+}
+
+/*
+ * yield_to() between two offsched tasks of the same CPU.
+ */
+static bool yield_to_task_offsched(struct rq *rq, struct task_struct *p,
+	bool preempt)
+{
+	if (task_rq(p) != rq || offsched_edf(&p->offsched))
+		return false;
+
+	offsched_set_next(rq, p);
+	yield_task_offsched(rq);
+
+	return true;
 }
 
-static void check_preempt_curr_offsched (struct rq *rq, struct task_struct *p,
+/*
+ * pick_next_offsched() as if @skip, the current task about to block, was
+ * no longer queued. @skip may be NULL.
+ */
+static struct offsched_entity *
+pick_next_offsched_skip(struct offsched_rq *offsched_rq,
+	struct offsched_entity *skip)
+{
+	struct offsched_prio_array *array = &offsched_rq->active_array;
+	struct rb_node *left = rb_first_cached(&offsched_rq->edf_root);
+	struct offsched_entity *offsched;
+	int idx;
+
+	if (left && skip && left == &skip->rb_node)
+		left = rb_next(left);
+	if (left)
+		return rb_entry(left, struct offsched_entity, rb_node);
+
+	for_each_set_bit(idx, array->bitmap, MAX_OFFSCHED_PRIO) {
+		list_for_each_entry(offsched, array->queue + idx, list) {
+			if (offsched != skip)
+				return offsched;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Directed handoff to @p, an offsched task of this CPU: wake it if it
+ * sleeps, which is a local wakeup and skips the wake_list, put it ahead of
+ * its equals and schedule(). Like for schedule(), the caller sets its own
+ * state first if it wants to block until woken.
+ *
+ * The handoff only reorders @p among its equals: a queued EDF task, or one
+ * of a higher priority, still runs first, and so does the caller if it
+ * outranks @p and does not block. Returns -EAGAIN, having scheduled all
+ * the same, if so at the time of the call, 0 if @p was next. Returns
+ * -EINVAL, without scheduling, if @p is not an offsched task of this CPU.
+ */
+int offsched_switch_to(struct task_struct *p)
+{
+	struct offsched_entity *blocking = NULL;
+	struct rq_flags rf;
+	struct rq *rq;
+	int ret = 0;
+
+	if (current->sched_class != &offsched_sched_class ||
+	    p->sched_class != &offsched_sched_class || p == current ||
+	    READ_ONCE(p->offsched.cpu) != raw_smp_processor_id())
+		goto err;
+
+	wake_up_process(p);
+
+	rq = this_rq();
+	rq_lock_irq(rq, &rf);
+	if (task_rq(p) == rq && task_on_rq_queued(p)) {
+		offsched_set_next(rq, p);
+
+		/* schedule() dequeues us first */
+		if (current->state != TASK_RUNNING)
+			blocking = &current->offsched;
+		if (pick_next_offsched_skip(&rq->offsched, blocking) !=
+		    &p->offsched)
+			ret = -EAGAIN;
+	} else {
+		ret = -EINVAL;
+	}
+	rq_unlock_irq(rq, &rf);
+
+	/* Even if @p went away meanwhile, the caller may be blocking */
+	schedule();
+
+	return ret;
+
+err:
+	__set_current_state(TASK_RUNNING);
+	return -EINVAL;
+}
+EXPORT_SYMBOL_GPL(offsched_switch_to);
+
+/*
+ * Whether @p beats a task of rank @prio, @edf and @deadline by strict
+ * priority: EDF tasks come first, by deadline among them, then the higher
+ * sched_priority. Also used without the rq lock as a hint, hence the
+ * priority from rt_priority.
+ */
+static bool offsched_preempts_rank(struct task_struct *p, int prio, bool edf,
+	u64 deadline)
+{
+	if (offsched_edf(&p->offsched))
+		return !edf || dl_time_before(p->offsched.deadline, deadline);
+
+	if (edf)
+		return false;
+
+	return offsched_queue_idx(p) < prio;
+}
+
+static bool offsched_preempts(struct task_struct *p, struct task_struct *curr)
+{
+	return offsched_preempts_rank(p, offsched_queue_idx(curr),
+		offsched_edf(&curr->offsched), curr->offsched.deadline);
+}
+
+/*
+ * Publish the rank of @curr, the offsched task now running on @rq, or NULL
+ * once none is. Written under the rq lock, read by offsched_wakeup_kick().
+ */
+static void offsched_set_curr_rank(struct rq *rq, struct task_struct *curr)
+{
+	struct offsched_rq *offsched_rq = &rq->offsched;
+
+	if (!curr) {
+		WRITE_ONCE(offsched_rq->curr_prio, MAX_OFFSCHED_PRIO);
+		return;
+	}
+
+	WRITE_ONCE(offsched_rq->curr_edf, offsched_edf(&curr->offsched));
+	WRITE_ONCE(offsched_rq->curr_deadline, curr->offsched.deadline);
+	WRITE_ONCE(offsched_rq->curr_prio, offsched_queue_idx(curr));
+}
+
+static void check_preempt_curr_offsched(struct rq *rq, struct task_struct *p,
 	int flags)
 {
+	switch (READ_ONCE(offsched_tunables.wakeup_preempt)) {
+	case OFFSCHED_PREEMPT_PRIO:
+		if (offsched_preempts(p, rq->curr))
+			resched_curr(rq);
+		break;
+	case OFFSCHED_PREEMPT_NEXT:
+		/* Ahead of its equals, and of rq->curr unless it is outranked */
+		offsched_set_next(rq, p);
+		if (pick_next_offsched(&rq->offsched) == &p->offsched)
+			resched_curr(rq);
+		break;
+	}
+}
+
+/*
+ * A remote wakeup only rings the doorbell, which offsched_idle() watches.
+ * Tell the waker whether the task running on @rq should be interrupted to
+ * look at the wake_list, see offsched_ttwu_ipi(). Lockless, a hint: rq->curr
+ * may be freed under us, only the rank @rq published is looked at.
+ */
+bool offsched_wakeup_kick(struct rq *rq, struct task_struct *p)
+{
+	struct offsched_rq *offsched_rq = &rq->offsched;
+	int prio = READ_ONCE(offsched_rq->curr_prio);
+
+	if (prio == MAX_OFFSCHED_PRIO)
+		return false;
+
+	switch (READ_ONCE(offsched_tunables.wakeup_preempt)) {
+	case OFFSCHED_PREEMPT_PRIO:
+		return offsched_preempts_rank(p, prio,
+			READ_ONCE(offsched_rq->curr_edf),
+			READ_ONCE(offsched_rq->curr_deadline));
+	case OFFSCHED_PREEMPT_NEXT:
+		return true;
+	}
+
+	return false;
+}
+
+static DEFINE_PER_CPU(struct callback_head, offsched_push_head);
+
+/*
+ * The CPU sched_setattr() sent @p to, see offsched_push_task(), if it may
+ * still go there. -1 otherwise.
+ */
+static int offsched_requested_cpu(struct task_struct *p)
+{
+	int cpu = READ_ONCE(p->offsched.push_cpu);
+
+	if (cpu < 0 || !cpu_offsched(cpu) ||
+	    !READ_ONCE(cpu_rq(cpu)->offsched.active) ||
+	    !cpumask_test_cpu(cpu, &p->cpus_allowed))
+		return -1;
+
+	return cpu;
+}
+
+static inline bool offsched_misplaced(struct rq *rq, struct task_struct *p)
+{
+	int push_cpu = p->offsched.push_cpu;
+
+	return !cpumask_test_cpu(cpu_of(rq), &p->cpus_allowed) ||
+		(push_cpu >= 0 && push_cpu != cpu_of(rq));
+}
+
+static void offsched_detach_task(struct rq *rq, struct task_struct *p)
+{
+	p->on_rq = TASK_ON_RQ_MIGRATING;
+	deactivate_task(rq, p, DEQUEUE_NOCLOCK);
+	list_add_tail(&p->offsched.list, &rq->offsched.push_list);
+}
+
+/*
+ * Take the queued tasks that may no longer run here, or @all of them, off
+ * the queues in one go and collect them on push_list. Returns how many.
+ */
+static unsigned int offsched_detach_tasks(struct rq *rq, bool all)
+{
+	struct offsched_rq *offsched_rq = &rq->offsched;
+	struct offsched_prio_array *array = &offsched_rq->active_array;
+	struct offsched_entity *offsched, *n;
+	struct rb_node *node, *next;
+	struct task_struct *p;
+	unsigned int nr = 0;
+	int idx;
+
+	offsched_rq->push_pending = false;
+
+	for_each_set_bit(idx, array->bitmap, MAX_OFFSCHED_PRIO) {
+		list_for_each_entry_safe(offsched, n, array->queue + idx, list) {
+			p = task_of_offsched(offsched);
+			if (all || offsched_misplaced(rq, p)) {
+				offsched_detach_task(rq, p);
+				nr++;
+			}
+		}
+	}
+
+	for (node = rb_first_cached(&offsched_rq->edf_root); node; node = next) {
+		next = rb_next(node);
+		offsched = rb_entry(node, struct offsched_entity, rb_node);
+		p = task_of_offsched(offsched);
+		if (all || offsched_misplaced(rq, p)) {
+			offsched_detach_task(rq, p);
+			nr++;
+		}
+	}
+
+	return nr;
+}
+
+/*
+ * Where a detached task goes: the CPU sched_setattr() asked for, else the
+ * least loaded offsched CPU it may use, an online one of its affinity
+ * otherwise. An @exiting CPU can't keep it, so as a last resort it goes to a
+ * housekeeping CPU whatever its affinity.
+ */
+static int offsched_push_cpu(struct rq *rq, struct task_struct *p,
+	bool exiting)
+{
+	int cpu;
+
+	cpu = offsched_requested_cpu(p);
+	p->offsched.push_cpu = -1;
+	if (cpu >= 0)
+		return cpu;
+
+	cpu = offsched_select_cpu(p);
+	if (cpu >= 0)
+		return cpu;
+
+	cpu = cpumask_any_and(cpu_active_mask, &p->cpus_allowed);
+	if (cpu < nr_cpu_ids)
+		return cpu;
+
+	if (!exiting)
+		return cpu_of(rq);
+
+	cpu = cpumask_any_and(cpu_active_mask,
+		housekeeping_cpumask(HK_FLAG_DOMAIN));
+	return cpu < nr_cpu_ids ? cpu : cpumask_any(cpu_active_mask);
+}
+
+/*
+ * Send the tasks on push_list where offsched_push_cpu() says, then attach
+ * them taking every destination rq lock once for the whole batch. Called
+ * and returns with rq->lock held, drops it meanwhile. When @exiting, tasks
+ * that had to leave the offsched CPUs are marked for offsched_revert_fn()
+ * unless exit_revert is off.
+ * Returns how many of those there were.
+ */
+static unsigned int offsched_push_list(struct rq *rq, bool exiting)
+{
+	struct offsched_entity *offsched, *n;
+	unsigned int nr_reverted = 0;
+	struct task_struct *p;
+	struct rq *dst_rq;
+	struct rq_flags rf;
+	LIST_HEAD(tasks);
+	int cpu;
+
+	list_splice_init(&rq->offsched.push_list, &tasks);
+
+	list_for_each_entry(offsched, &tasks, list) {
+		p = task_of_offsched(offsched);
+
+		cpu = offsched_push_cpu(rq, p, exiting);
+		if (exiting && !cpu_offsched(cpu) &&
+		    READ_ONCE(offsched_tunables.exit_revert)) {
+			WRITE_ONCE(offsched->drained, true);
+			nr_reverted++;
+		}
+
+		set_task_cpu(p, cpu);
+		offsched_edf_move(p, cpu);
+
+		/* Account it there now, so that the rest of the batch spreads */
+		if (offsched->cpu != cpu) {
+			atomic_dec(&rq->offsched.nr_total);
+			atomic_inc(&cpu_rq(cpu)->offsched.nr_total);
+			offsched->cpu = cpu;
+		}
+	}
+
+	raw_spin_unlock(&rq->lock);
+
+	while (!list_empty(&tasks)) {
+		offsched = list_first_entry(&tasks, struct offsched_entity, list);
+		dst_rq = task_rq(task_of_offsched(offsched));
+
+		rq_lock(dst_rq, &rf);
+		update_rq_clock(dst_rq);
+
+		list_for_each_entry_safe(offsched, n, &tasks, list) {
+			p = task_of_offsched(offsched);
+			if (task_rq(p) != dst_rq)
+				continue;
+
+			list_del_init(&offsched->list);
+			activate_task(dst_rq, p, ENQUEUE_NOCLOCK);
+			p->on_rq = TASK_ON_RQ_QUEUED;
+			check_preempt_curr(dst_rq, p, 0);
+		}
+
+		rq_unlock(dst_rq, &rf);
+	}
+
+	raw_spin_lock(&rq->lock);
+
+	return nr_reverted;
+}
+
+/* Balance callback, after the pick that detached the misplaced tasks */
+static void offsched_push_tasks(struct rq *rq)
+{
+	offsched_push_list(rq, false);
+}
+
+/*
+ * Affinity changes leave queued tasks behind, set_cpus_allowed_offsched()
+ * flags them. Take all of them off the queues in one go, @prev included:
+ * set_task_cpu() has to wait until we switched away from it, so moving
+ * them is left to offsched_push_tasks() after the switch.
+ */
+static void offsched_detach_misplaced(struct rq *rq)
+{
+	if (offsched_detach_tasks(rq, false))
+		queue_balance_callback(rq, &per_cpu(offsched_push_head, cpu_of(rq)),
+			offsched_push_tasks);
 }
 
 static struct task_struct *pick_next_task_offsched(struct rq *rq,
 	struct task_struct *prev, struct rq_flags *rf)
 {
 	struct offsched_rq *offsched_rq = &rq->offsched;
-	struct task_struct *next = offsched_rq->next;
-	struct offsched_entity *next_next_offsched;
+	struct offsched_entity *offsched;
+	struct task_struct *next = NULL;
 
 	if (!offsched_rq->active)
 		return NULL;
 
-	/* check if there are sleeping tasks */
-	if (offsched_rq->nr_running != offsched_rq->nr_total)
-		sched_ttwu_pending();
+	/*
+	 * Remote wakers leave the wake_list non-empty, so only drain when
+	 * something is actually queued instead of whenever a task sleeps.
+	 */
+	if (!llist_empty(&offsched_rq->wake_list)) {
+		__this_cpu_inc(offsched_stat.nr_drains);
+		offsched_ttwu_pending(rq, rf);
+	} else if (offsched_rq->nr_running !=
+			atomic_read(&offsched_rq->nr_total)) {
+		__this_cpu_inc(offsched_stat.nr_drains_skipped);
+	}
+
+	/* An EDF prev may have to move back in the tree before we look */
+	if (prev->sched_class == &offsched_sched_class)
+		update_curr_offsched(rq);
 
-	if (next) {
-		next_next_offsched = pick_next_offsched(offsched_rq,
-			&next->offsched);
-		offsched_rq->next = task_of_offsched(next_next_offsched);
+	if (unlikely(offsched_rq->push_pending))
+		offsched_detach_misplaced(rq);
 
-		/* account_offsched_time() if prev == next */
-		put_prev_task(rq, prev);
+	offsched = pick_next_offsched(offsched_rq);
+	if (offsched) {
+		next = task_of_offsched(offsched);
 
-		next->offsched.jiffies = jiffies;
+		/* Round-robin within the priority */
+		if (!offsched_edf(offsched))
+			list_move_tail(&offsched->list,
+				offsched_rq->active_array.queue + offsched->prio);
+
+		/* update_curr_offsched() if prev == next */
+		put_prev_task(rq, prev);
+		if (next != prev)
+			__this_cpu_inc(offsched_stat.nr_switches);
+		trace_sched_offsched_pick(prev, next, offsched_rq->nr_running);
+
+		next->offsched.exec_start = rq_clock_task(rq);
+		offsched_set_curr_rank(rq, next);
+		offsched_start_slice(offsched_rq, offsched_slice(next));
+	} else {
+		offsched_stop_slice(offsched_rq);
 	}
 
 	return next;
 }
 
-static inline void account_offsched_time(struct task_struct *p)
+static void put_prev_task_offsched(struct rq *rq, struct task_struct *p)
 {
-	struct offsched_entity *offsched = &p->offsched;
-	u64 cputime = (jiffies - offsched->jiffies) * TICK_NSEC;
+	update_curr_offsched(rq);
+	offsched_set_curr_rank(rq, NULL);
+}
+
+/*
+ * Memory node of @p: the NUMA balancing preference if there is one, the
+ * node it last ran on otherwise.
+ */
+static int offsched_task_node(struct task_struct *p)
+{
+#ifdef CONFIG_NUMA_BALANCING
+	if (p->numa_preferred_nid != -1)
+		return p->numa_preferred_nid;
+#endif
+	return cpu_to_node(task_cpu(p));
+}
+
+/*
+ * Least loaded offsched CPU @p may run on, preferring the ones on its memory
+ * node. Load is the number of tasks bound to the CPU, sleeping ones included,
+ * then the reserved EDF bandwidth; EDF tasks look at the bandwidth first.
+ * No locks, the counters are only a hint. Returns -1 if there is none.
+ */
+int offsched_select_cpu(struct task_struct *p)
+{
+	bool edf = offsched_edf(&p->offsched);
+	int cpu, best_cpu = -1, node = offsched_task_node(p);
+	bool local, best_local = false;
+	u64 load, best_load = 0;
+	struct offsched_rq *offsched_rq;
+	u64 nr, bw;
+
+	for_each_cpu_and(cpu, cpu_offsched_mask, &p->cpus_allowed) {
+		offsched_rq = &cpu_rq(cpu)->offsched;
+		/* Exiting, see offsched_exit_migrate() */
+		if (!READ_ONCE(offsched_rq->active))
+			continue;
+
+		nr = atomic_read(&offsched_rq->nr_total);
+		bw = READ_ONCE(offsched_rq->edf_bw);
+		/* both fit in 32 bits, edf_bw is capped at BW_UNIT */
+		load = edf ? (bw << 32) | nr : (nr << 32) | bw;
+		local = cpu_to_node(cpu) == node;
+
+		if (best_cpu >= 0) {
+			if (best_local && !local)
+				continue;
+			if (best_local == local && load >= best_load)
+				continue;
+		}
 
-	account_user_time(p, cputime);
+		best_cpu = cpu;
+		best_load = load;
+		best_local = local;
+	}
+
+	return best_cpu;
 }
 
-static void put_prev_task_offsched(struct rq *rq, struct task_struct *p)
+/*
+ * CPU __sched_setscheduler() moves @p to once it is SCHED_OFFSCHED: the one
+ * it asked for, the one its EDF bandwidth is charged to, or the least loaded
+ * one if it isn't on an offsched CPU yet. -1 leaves it where it is.
+ */
+int offsched_place_cpu(struct task_struct *p, const struct sched_attr *attr)
 {
-	account_offsched_time(p);
+	if (attr->sched_flags & SCHED_FLAG_OFFSCHED_CPU)
+		return attr->sched_offsched_cpu;
+	if (p->offsched.edf_cpu >= 0)
+		return p->offsched.edf_cpu;
+	if (cpu_offsched(task_cpu(p)))
+		return -1;
+	return offsched_select_cpu(p);
 }
 
+/*
+ * Tasks stick to their offsched CPU. Those not placed on one yet, fresh forks
+ * and tasks that just switched to SCHED_OFFSCHED, go to the least loaded one.
+ */
 static int select_task_rq_offsched(struct task_struct *p, int task_cpu,
 	int sd_flag, int flags)
 {
 	struct offsched_entity *offsched = &p->offsched;
+	int cpu;
 
-	if (offsched->cpu >= 0)
+	cpu = offsched_requested_cpu(p);
+	if (cpu >= 0)
+		return cpu;
+
+	if (offsched->cpu >= 0 && cpu_offsched(offsched->cpu) &&
+	    READ_ONCE(cpu_rq(offsched->cpu)->offsched.active) &&
+	    cpumask_test_cpu(offsched->cpu, &p->cpus_allowed))
+		return offsched->cpu;
+
+	cpu = offsched_select_cpu(p);
+	if (cpu >= 0)
+		return cpu;
+
+	/*
+	 * Waiting for its CPU to go offsched. An exiting one is no place to
+	 * wait, select_task_rq() falls back to an online CPU.
+	 */
+	if (offsched->cpu >= 0 && !cpu_offsched(offsched->cpu))
 		return offsched->cpu;
 
 	return task_cpu;
 }
 
+/*
+ * Called with the task rq locked: send @p to the offsched CPU @cpu, as
+ * sched_setattr() asked. The stopper of an offsched CPU is parked, so if
+ * @p is queued on one, that CPU pushes it itself at its next pick, like the
+ * tasks that lost it from their affinity; a sleeping or waking @p goes
+ * there from select_task_rq_offsched() or enqueue_task_offsched().
+ */
+void offsched_push_task(struct rq *rq, struct task_struct *p, int cpu)
+{
+	p->offsched.push_cpu = cpu;
+
+	if (!task_on_rq_queued(p) || !cpu_offsched(cpu_of(rq)))
+		return;
+
+	rq->offsched.push_pending = true;
+	if (!is_idle_task(rq->curr))
+		resched_curr(rq);
+}
+
+/*
+ * Called with the task rq locked and @p dequeued. A queued task that lost
+ * its offsched CPU is pushed away by that CPU at its next pick, together
+ * with any other such task; make it pick soon. Blocked tasks are placed
+ * by select_task_rq_offsched() when they wake up.
+ */
 static void set_cpus_allowed_offsched(struct task_struct *p,
 	const struct cpumask *newmask)
 {
+	struct rq *rq = task_rq(p);
+
+	set_cpus_allowed_common(p, newmask);
+
+	if (!task_on_rq_queued(p) || !cpu_offsched(cpu_of(rq)) ||
+	    cpumask_test_cpu(cpu_of(rq), newmask))
+		return;
+
+	rq->offsched.push_pending = true;
+	if (!is_idle_task(rq->curr))
+		resched_curr(rq);
 }
 
 static void rq_online_offsched(struct rq *rq)
@@ -184,6 +1372,8 @@ static void rq_offline_offsched(struct rq *rq)
 
 static void set_curr_task_offsched(struct rq *rq)
 {
+	rq->curr->offsched.exec_start = rq_clock_task(rq);
+	offsched_set_curr_rank(rq, rq->curr);
 }
 
 static void task_tick_offsched(struct rq *rq, struct task_struct *p,
@@ -195,24 +1385,39 @@ static void task_tick_offsched(struct rq *rq, struct task_struct *p,
 static void task_dead_offsched(struct task_struct *p)
 {
 	struct offsched_entity *offsched = &p->offsched;
-	struct rq *rq = cpu_rq(offsched->cpu);
-	struct offsched_rq *offsched_rq = &rq->offsched;
 
-	offsched_rq->nr_total--;
+	offsched_edf_release(p);
+
+	if (offsched->cpu < 0)
+		return;
 
-	__offsched_raw("OFFSCHED_C: task_dead(): ", p);
+	atomic_dec(&cpu_rq(offsched->cpu)->offsched.nr_total);
+
+	trace_sched_offsched_task_dead(p, offsched->cpu,
+		READ_ONCE(cpu_rq(offsched->cpu)->offsched.nr_running));
+	offsched_log(OFFSCHED_LOG_TASK_DEAD, p->pid, offsched->cpu);
 }
 
-static void switched_to_offsched(struct rq *this_rq, struct task_struct *task)
+/*
+ * The task no longer counts against the offsched CPU it was bound to.
+ */
+static void switched_from_offsched(struct rq *this_rq, struct task_struct *p)
 {
+	struct offsched_entity *offsched = &p->offsched;
+
+	if (offsched->cpu < 0)
+		return;
+
+	atomic_dec(&cpu_rq(offsched->cpu)->offsched.nr_total);
+	offsched->cpu = -1;
 }
 
-static void prio_changed_offsched(struct rq *this_rq, struct task_struct *task,
-	int oldprio)
+static void switched_to_offsched(struct rq *this_rq, struct task_struct *task)
 {
 }
 
-static void update_curr_offsched(struct rq *rq)
+static void prio_changed_offsched(struct rq *this_rq, struct task_struct *task,
+	int oldprio)
 {
 }
 
@@ -221,28 +1426,30 @@ const struct sched_class offsched_sched_class = {
 
 	.enqueue_task		= &enqueue_task_offsched,
 	.dequeue_task		= &dequeue_task_offsched,
-	.yield_task		= &yield_task_offsched,			/* Empty */
+	.yield_task		= &yield_task_offsched,
+	.yield_to_task		= &yield_to_task_offsched,
 
-	.check_preempt_curr	= &check_preempt_curr_offsched,		/* Empty */
+	.check_preempt_curr	= &check_preempt_curr_offsched,
 
 	.pick_next_task		= &pick_next_task_offsched,
 	.put_prev_task		= &put_prev_task_offsched,
 
 	.select_task_rq		= &select_task_rq_offsched,
 
-	.set_cpus_allowed	= &set_cpus_allowed_offsched,		/* Empty */
+	.set_cpus_allowed	= &set_cpus_allowed_offsched,
 
 	.rq_online		= &rq_online_offsched,			/* Empty */
 	.rq_offline		= &rq_offline_offsched,			/* Empty */
 
-	.set_curr_task		= &set_curr_task_offsched,		/* Empty */
+	.set_curr_task		= &set_curr_task_offsched,
 	.task_tick		= &task_tick_offsched,			/* BUG */
 	.task_dead		= &task_dead_offsched,
 
+	.switched_from		= &switched_from_offsched,
 	.switched_to		= &switched_to_offsched,		/* Empty */
 	.prio_changed		= &prio_changed_offsched,		/* Empty */
 
-	.update_curr		= &update_curr_offsched			/* Empty */
+	.update_curr		= &update_curr_offsched
 };
 
 void offsched_begin(void)
@@ -254,35 +1461,380 @@ void offsched_begin(void)
 
 	add_nr_running(rq, offsched_rq->nr_running);
 
-	__offsched_log("OFFSCHED_C: begin");
+	trace_sched_offsched_begin(cpu_of(rq), offsched_rq->nr_running,
+		atomic_read(&offsched_rq->nr_total));
+	offsched_log(OFFSCHED_LOG_BEGIN, current->pid, offsched_rq->nr_running);
 }
 EXPORT_SYMBOL(offsched_begin);
 
+/*
+ * Exit protocol: nothing may stay queued on a CPU going back to play_dead.
+ * Whatever is queued, or still on the wake_list, is detached in one batch
+ * and pushed to the least loaded offsched CPU each task may use. Tasks with
+ * no other offsched CPU go to an online one and, with exit_revert, are
+ * switched to SCHED_NORMAL by offsched_revert_fn(). Sleeping tasks are
+ * placed elsewhere by select_task_rq_offsched() when they wake up.
+ */
+static void offsched_exit_migrate(struct rq *rq)
+{
+	unsigned int nr_moved, nr_reverted = 0;
+	struct offsched_stat *stat;
+	struct rq_flags rf;
+	u64 start, delta;
+
+	start = local_clock();
+
+	/* Interrupts are on, and scheduler_ipi() may take the lock */
+	rq_lock_irqsave(rq, &rf);
+	update_rq_clock(rq);
+	offsched_ttwu_pending(rq, &rf);
+	nr_moved = offsched_detach_tasks(rq, true);
+
+	/* offsched_push_list() drops the lock, like a balance callback */
+	rq_unpin_lock(rq, &rf);
+	if (nr_moved)
+		nr_reverted = offsched_push_list(rq, true);
+	raw_spin_unlock_irqrestore(&rq->lock, rf.flags);
+
+	delta = local_clock() - start;
+
+	stat = this_cpu_ptr(&offsched_stat);
+	stat->nr_exit_moved += nr_moved;
+	stat->nr_exit_reverted += nr_reverted;
+	stat->exit_ns += delta;
+
+	trace_sched_offsched_exit_migrate(cpu_of(rq), nr_moved, nr_reverted,
+		delta);
+}
+
 void offsched_end(void)
 {
 	struct rq *rq = cpu_rq(smp_processor_id());
 	struct offsched_rq *offsched_rq = &rq->offsched;
 
+	/* Before !active, for offsched_wake_fallback() */
+	cpumask_set_cpu(cpu_of(rq), &offsched_revert_pending);
+	smp_mb__after_atomic();
 	offsched_rq->active = false;
+	offsched_stop_slice(offsched_rq);
 
 	sub_nr_running(rq, offsched_rq->nr_running);
 
-	__offsched_log("OFFSCHED_C: end");
+	/*
+	 * Order !active against the wake_list check of offsched_exit_migrate(),
+	 * and let the wakers that saw us active finish queueing. Later ones
+	 * go elsewhere, see ttwu_queue().
+	 */
+	smp_mb();
+	while (atomic_read(&offsched_rq->nr_wakers))
+		cpu_relax();
+	offsched_exit_migrate(rq);
+
+	trace_sched_offsched_end(cpu_of(rq), offsched_rq->nr_running,
+		atomic_read(&offsched_rq->nr_total));
+	offsched_log(OFFSCHED_LOG_END, current->pid, offsched_rq->nr_running);
 }
 EXPORT_SYMBOL(offsched_end);
 
+/*
+ * Called by the CPU that ran the offsched callback once it is out of
+ * cpu_offsched_mask: offsched_revert_fn() skips the tasks of offsched CPUs.
+ */
+void offsched_cpu_exited(int cpu)
+{
+	if (cpumask_test_cpu(cpu, &offsched_revert_pending))
+		queue_work(system_unbound_wq, &offsched_revert_work);
+}
+
+/*
+ * A wakeup found no offsched CPU for @p and sends it to an online one. If
+ * that is because its own CPU left offsched, it goes back to SCHED_NORMAL
+ * with exit_revert like the tasks offsched_exit_migrate() pushed away: the
+ * wakeup moves offsched.cpu, offsched_revert_fn() goes by drained.
+ */
+void offsched_wake_fallback(struct task_struct *p)
+{
+	int cpu = READ_ONCE(p->offsched.cpu);
+
+	if (cpu < 0 || !READ_ONCE(offsched_tunables.exit_revert))
+		return;
+
+	/* The caller saw !active, pairs with offsched_end() */
+	smp_rmb();
+
+	if (cpumask_test_cpu(cpu, &offsched_revert_pending) ||
+	    cpumask_test_cpu(cpu, &offsched_reverting))
+		WRITE_ONCE(p->offsched.drained, true);
+}
+
+/*
+ * Switch the SCHED_FLAG_OFFSCHED_REVERT tasks of the CPUs that left offsched,
+ * and the tasks offsched_exit_migrate() found no offsched CPU for, back to
+ * SCHED_NORMAL. __sched_setscheduler() moves them to an online CPU.
+ *
+ * offsched_exit_migrate() only sees the queued tasks. The ones sleeping on
+ * such a CPU still point to it: unless exit_revert is off, they are
+ * reverted as well when no other offsched CPU would take them, the others
+ * get one from select_task_rq_offsched() at their next wakeup. Those that
+ * woke up meanwhile with nowhere offsched to go are drained as well, see
+ * offsched_wake_fallback().
+ */
+static void offsched_revert_fn(struct work_struct *work)
+{
+	struct sched_param param = { .sched_priority = 0 };
+	struct task_struct *g, *p;
+	int cpu;
+
+	/* Never in neither, for offsched_wake_fallback() */
+	for_each_cpu(cpu, &offsched_revert_pending) {
+		cpumask_set_cpu(cpu, &offsched_reverting);
+		cpumask_clear_cpu(cpu, &offsched_revert_pending);
+	}
+
+	rcu_read_lock();
+	for_each_process_thread(g, p) {
+		if (p->policy != SCHED_OFFSCHED)
+			continue;
+
+		if (READ_ONCE(p->offsched.drained)) {
+			WRITE_ONCE(p->offsched.drained, false);
+			sched_setscheduler_nocheck(p, SCHED_NORMAL, &param);
+			continue;
+		}
+
+		cpu = READ_ONCE(p->offsched.cpu);
+		if (cpu < 0 || cpu_offsched(cpu) ||
+		    !cpumask_test_cpu(cpu, &offsched_reverting))
+			continue;
+
+		if (!(p->offsched.flags & SCHED_FLAG_OFFSCHED_REVERT) &&
+		    !(READ_ONCE(offsched_tunables.exit_revert) &&
+		      offsched_select_cpu(p) < 0))
+			continue;
+
+		sched_setscheduler_nocheck(p, SCHED_NORMAL, &param);
+	}
+	rcu_read_unlock();
+
+	cpumask_clear(&offsched_reverting);
+}
+
+/*
+ * Nothing to wait for: either something became runnable or queued on the
+ * wake_list, or the last offsched task of this CPU is gone.
+ */
+static inline bool offsched_idle_done(struct rq *rq)
+{
+	return READ_ONCE(rq->offsched.nr_running) ||
+		!llist_empty(&rq->offsched.wake_list) ||
+		!atomic_read(&rq->offsched.nr_total);
+}
+
+/*
+ * 0: shares the LLC, 1: same node, 2: anywhere else.
+ */
+static int offsched_steal_distance(int this_cpu, int cpu)
+{
+	if (cpus_share_cache(this_cpu, cpu))
+		return 0;
+	if (cpu_to_node(this_cpu) == cpu_to_node(cpu))
+		return 1;
+	return 2;
+}
+
+/*
+ * Closest active sibling with something stealable queued behind its current
+ * task, the busiest one among equally close. Only reads nr_running and
+ * nr_stealable, no locks; the affinity of the tasks is left to
+ * offsched_steal_candidate().
+ */
+static int offsched_find_victim(int this_cpu)
+{
+	int cpu, dist, best_dist = INT_MAX, victim = -1;
+	unsigned int nr, best_nr = 0;
+	struct offsched_rq *offsched_rq;
+
+	for_each_offsched_cpu(cpu) {
+		if (cpu == this_cpu)
+			continue;
+
+		offsched_rq = &cpu_rq(cpu)->offsched;
+		nr = READ_ONCE(offsched_rq->nr_running);
+		if (nr <= 1 || !READ_ONCE(offsched_rq->nr_stealable) ||
+		    !READ_ONCE(offsched_rq->active))
+			continue;
+
+		dist = offsched_steal_distance(this_cpu, cpu);
+		if (dist < best_dist || (dist == best_dist && nr > best_nr)) {
+			best_dist = dist;
+			best_nr = nr;
+			victim = cpu;
+		}
+	}
+
+	return victim;
+}
+
+/*
+ * Highest priority queued task of @src_rq that may run on @this_cpu. EDF
+ * tasks stay put, their bandwidth is reserved on their CPU.
+ */
+static struct task_struct *offsched_steal_candidate(struct rq *src_rq,
+	int this_cpu)
+{
+	struct offsched_prio_array *array = &src_rq->offsched.active_array;
+	struct offsched_entity *offsched;
+	struct task_struct *p;
+	int idx;
+
+	for_each_set_bit(idx, array->bitmap, MAX_OFFSCHED_PRIO) {
+		list_for_each_entry(offsched, array->queue + idx, list) {
+			p = task_of_offsched(offsched);
+			if (task_running(src_rq, p))
+				continue;
+			if (!cpumask_test_cpu(this_cpu, &p->cpus_allowed))
+				continue;
+			if (!offsched_stealable(offsched))
+				continue;
+			return p;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Called from offsched_idle() with no lock held. Interrupts are on there,
+ * and scheduler_ipi() takes our rq lock, see offsched_ttwu_ipi().
+ */
+static bool offsched_steal(struct rq *this_rq)
+{
+	int this_cpu = cpu_of(this_rq);
+	struct task_struct *p;
+	unsigned long flags;
+	struct rq *src_rq;
+	int victim;
+
+	if (!this_rq->offsched.active)
+		return false;
+
+	victim = offsched_find_victim(this_cpu);
+	if (victim < 0)
+		return false;
+
+	src_rq = cpu_rq(victim);
+
+	local_irq_save(flags);
+	double_rq_lock(this_rq, src_rq);
+	update_rq_clock(this_rq);
+	update_rq_clock(src_rq);
+
+	p = offsched_steal_candidate(src_rq, this_cpu);
+	if (p) {
+		deactivate_task(src_rq, p, 0);
+		set_task_cpu(p, this_cpu);
+		activate_task(this_rq, p, 0);
+	}
+
+	double_rq_unlock(this_rq, src_rq);
+	local_irq_restore(flags);
+
+	if (p)
+		__this_cpu_inc(offsched_stat.nr_steals);
+
+	return p != NULL;
+}
+
+static void offsched_drain_wake_list(struct rq *rq)
+{
+	struct rq_flags rf;
+
+	if (llist_empty(&rq->offsched.wake_list))
+		return;
+
+	rq_lock_irqsave(rq, &rf);
+	update_rq_clock(rq);
+	offsched_ttwu_pending(rq, &rf);
+	rq_unlock_irqrestore(rq, &rf);
+}
+
+/*
+ * A failed steal, the victim only had tasks we may not take, is not retried
+ * before this long while polling, doubled on each failure up to the max,
+ * unless a sibling rings our doorbell, see offsched_kick_idle(). The MWAIT
+ * loop only steals when the doorbell rings.
+ */
+#define OFFSCHED_STEAL_BACKOFF_NS	(1 * NSEC_PER_USEC)
+#define OFFSCHED_STEAL_BACKOFF_MAX_NS	(256 * NSEC_PER_USEC)
+
+static void offsched_idle_wait(struct rq *rq)
+{
+	struct offsched_rq *offsched_rq = &rq->offsched;
+	u64 poll_end = local_clock() + READ_ONCE(offsched_tunables.idle_poll_ns);
+	bool steal = READ_ONCE(offsched_tunables.steal);
+	u64 backoff = OFFSCHED_STEAL_BACKOFF_NS, next_steal = 0, now;
+
+	if (steal)
+		cpumask_set_cpu(cpu_of(rq), &offsched_idle_cpus);
+
+	while (!offsched_idle_done(rq)) {
+		if (steal && READ_ONCE(offsched_rq->doorbell)) {
+			WRITE_ONCE(offsched_rq->doorbell, 0);
+			backoff = OFFSCHED_STEAL_BACKOFF_NS;
+			next_steal = 0;
+		}
+
+		now = local_clock();
+		if (steal && now >= next_steal) {
+			if (offsched_steal(rq))
+				goto out;
+			next_steal = now + backoff;
+			backoff = min_t(u64, 2 * backoff,
+					OFFSCHED_STEAL_BACKOFF_MAX_NS);
+		}
+		if (READ_ONCE(offsched_tunables.idle_mwait) && now >= poll_end)
+			goto mwait;
+		cpu_relax();
+	}
+	goto out;
+
+mwait:
+	for (;;) {
+		WRITE_ONCE(offsched_rq->doorbell, 0);
+		/* Pairs with smp_mb() in offsched_ring_doorbell() */
+		smp_mb();
+
+		if (offsched_idle_done(rq) || (steal && offsched_steal(rq)))
+			break;
+
+		if (!offsched_mwait(&offsched_rq->doorbell, 0,
+				READ_ONCE(offsched_tunables.idle_mwait_hint)))
+			cpu_relax();
+	}
+
+out:
+	if (steal)
+		cpumask_clear_cpu(cpu_of(rq), &offsched_idle_cpus);
+}
+
 void offsched_idle(void)
 {
 	struct rq *rq = cpu_rq(smp_processor_id());
 	struct offsched_rq *offsched_rq = &rq->offsched;
-	int i;
+	u64 start, idle_ns;
 
-	while (offsched_rq->nr_total > 0) {
-		sched_ttwu_pending();
+	while (atomic_read(&offsched_rq->nr_total) > 0) {
+		offsched_drain_wake_list(rq);
 		schedule();
 
-		for (i = 0; i < 1000000; i++) {
-		}
+		__this_cpu_inc(offsched_stat.nr_idle_loops);
+		start = local_clock();
+		offsched_idle_wait(rq);
+		idle_ns = local_clock() - start;
+		__this_cpu_add(offsched_stat.idle_ns, idle_ns);
+
+		trace_sched_offsched_idle_wake(cpu_of(rq), idle_ns,
+			READ_ONCE(offsched_rq->nr_running));
 	}
 }
 EXPORT_SYMBOL(offsched_idle);
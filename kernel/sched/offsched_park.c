@@ -0,0 +1,182 @@
+/*
+ * Offsched park: take an online CPU to offsched duty and back without a
+ * CPU hotplug cycle.
+ *
+ * cpu_down() runs every teardown state, drains per-CPU caches and leaves
+ * the CPU to be booted again with INIT/SIPI. An offsched CPU only needs to
+ * be out of the active and online masks with its tasks, IRQs, timers and
+ * per-CPU kthreads gone, and RCU not waiting for it. offsched_park() does
+ * just that, with the hotplug callbacks of those subsystems, and the idle
+ * task of the CPU runs the offsched callback as native_play_dead() would.
+ * When the callback returns the CPU comes back online by itself.
+ *
+ * The CPU stays in the CPUHP_ONLINE state meanwhile, so CPU hotplug is
+ * disabled while it is parked.
+ */
+#include <linux/cpu.h>
+#include <linux/hrtimer.h>
+#include <linux/timer.h>
+#include <linux/tick.h>
+#include <linux/rcupdate.h>
+#include <linux/stop_machine.h>
+#include <linux/workqueue.h>
+#include <linux/offsched.h>
+
+#include "sched.h"
+#include "../smpboot.h"
+
+DEFINE_PER_CPU(int, offsched_park_state);
+
+static void offsched_unpark_fn(struct work_struct *work);
+static DECLARE_WORK(offsched_unpark_work, offsched_unpark_fn);
+
+static inline void offsched_park_set(unsigned int cpu, int state)
+{
+	smp_store_release(&per_cpu(offsched_park_state, cpu), state);
+}
+
+/* The states only move forward until the CPU is back online */
+static inline void offsched_park_wait(unsigned int cpu, int state)
+{
+	while (smp_load_acquire(&per_cpu(offsched_park_state, cpu)) < state)
+		cpu_relax();
+}
+
+/*
+ * Idle task of a CPU offsched_park() asked to go, interrupts off. Returns
+ * once the CPU is back online.
+ */
+void offsched_park_play(void)
+{
+	unsigned int cpu = smp_processor_id();
+
+	/* Woken up since the eviction, let it run and come back */
+	if (this_rq()->nr_running)
+		return;
+
+	arch_offsched_park_cpu();
+	tick_handover_do_timer();
+
+	/*
+	 * Callers of smp_call_function*() that saw us online may still be
+	 * sending IPIs: serve them, idle, until offsched_park() knows they
+	 * are all done.
+	 */
+	offsched_park_set(cpu, OFFSCHED_PARK_SYNC);
+	rcu_idle_enter();
+	local_irq_enable();
+	offsched_park_wait(cpu, OFFSCHED_PARK_GO);
+	local_irq_disable();
+	rcu_idle_exit();
+	generic_smp_call_function_single_interrupt();
+
+	rcutree_dying_cpu(cpu);
+	rcu_report_dead(cpu);
+
+	offsched_park_set(cpu, OFFSCHED_PARKED);
+	run_offsched_callback();
+
+	offsched_park_set(cpu, OFFSCHED_UNPARK);
+	queue_work(system_unbound_wq, &offsched_unpark_work);
+	offsched_park_wait(cpu, OFFSCHED_UNPARK_GO);
+
+	rcu_cpu_starting(cpu);
+	sched_cpu_starting(cpu);
+	arch_offsched_unpark_cpu();
+
+	offsched_park_set(cpu, OFFSCHED_PARK_NONE);
+}
+
+/*
+ * Take @cpu to offsched duty, see above. It must be online and have an
+ * offsched callback. Returns once the CPU runs the callback.
+ */
+int offsched_park(unsigned int cpu)
+{
+	int ret;
+
+	if (cpu >= nr_cpu_ids || !is_offsched_callback(cpu))
+		return -EINVAL;
+
+	cpu_hotplug_disable();
+	cpus_write_lock();
+
+	if (!cpu_online(cpu) || num_active_cpus() == 1 ||
+	    per_cpu(offsched_park_state, cpu) != OFFSCHED_PARK_NONE) {
+		ret = -EBUSY;
+		goto out;
+	}
+
+	ret = sched_cpu_deactivate(cpu);
+	if (ret)
+		goto out;
+
+	workqueue_offline_cpu(cpu);
+	rcutree_offline_cpu(cpu);
+	smpboot_park_threads(cpu);
+	stop_one_cpu(cpu, arch_offsched_evict, NULL);
+
+	offsched_park_set(cpu, OFFSCHED_PARK_REQUEST);
+	wake_up_if_idle(cpu);
+	offsched_park_wait(cpu, OFFSCHED_PARK_SYNC);
+
+	/* Whoever saw @cpu online did so with preemption disabled */
+	synchronize_sched();
+	offsched_park_set(cpu, OFFSCHED_PARK_GO);
+	offsched_park_wait(cpu, OFFSCHED_PARKED);
+
+	hrtimers_dead_cpu(cpu);
+	timers_dead_cpu(cpu);
+	tick_cleanup_dead_cpu(cpu);
+	rcutree_migrate_callbacks(cpu);
+	rcutree_dead_cpu(cpu);
+
+	cpus_write_unlock();
+
+	return 0;
+
+out:
+	cpus_write_unlock();
+	cpu_hotplug_enable();
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(offsched_park);
+
+/*
+ * The offsched callback of a parked CPU returned: prepare what it needs
+ * before it goes online, then undo the rest of offsched_park().
+ */
+static void offsched_unpark(unsigned int cpu)
+{
+	cpus_write_lock();
+
+	hrtimers_prepare_cpu(cpu);
+	timers_prepare_cpu(cpu);
+	rcutree_prepare_cpu(cpu);
+
+	offsched_park_set(cpu, OFFSCHED_UNPARK_GO);
+	while (smp_load_acquire(&per_cpu(offsched_park_state, cpu)) !=
+	       OFFSCHED_PARK_NONE)
+		cpu_relax();
+
+	stop_machine_unpark(cpu);
+	rcutree_online_cpu(cpu);
+	smpboot_unpark_threads(cpu);
+	workqueue_online_cpu(cpu);
+	sched_cpu_activate(cpu);
+
+	cpus_write_unlock();
+	cpu_hotplug_enable();
+}
+
+static void offsched_unpark_fn(struct work_struct *work)
+{
+	unsigned int cpu;
+
+	for_each_possible_cpu(cpu) {
+		if (smp_load_acquire(&per_cpu(offsched_park_state, cpu)) ==
+		    OFFSCHED_UNPARK)
+			offsched_unpark(cpu);
+	}
+}
@@ -0,0 +1,163 @@
+/*
+ * Offsched statistics: /proc/offsched_stat and /sys/kernel/debug/offsched/
+ */
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
+#include <linux/debugfs.h>
+
+#include "sched.h"
+
+DEFINE_PER_CPU_SHARED_ALIGNED(struct offsched_stat, offsched_stat);
+
+/*
+ * Bump this up when changing the output format or the meaning of an
+ * existing format, so that tools can adapt (or abort)
+ */
+#define OFFSCHED_STAT_VERSION 2
+
+static void offsched_stat_add(struct offsched_stat *sum,
+			      const struct offsched_stat *stat)
+{
+	sum->nr_switches	+= stat->nr_switches;
+	sum->nr_wakeups		+= stat->nr_wakeups;
+	sum->nr_drains		+= stat->nr_drains;
+	sum->nr_drains_skipped	+= stat->nr_drains_skipped;
+	sum->nr_idle_loops	+= stat->nr_idle_loops;
+	sum->nr_steals		+= stat->nr_steals;
+	sum->idle_ns		+= stat->idle_ns;
+	sum->run_ns		+= stat->run_ns;
+	sum->nr_exit_moved	+= stat->nr_exit_moved;
+	sum->nr_exit_reverted	+= stat->nr_exit_reverted;
+	sum->exit_ns		+= stat->exit_ns;
+}
+
+static void offsched_stat_show(struct seq_file *seq,
+			       const struct offsched_stat *stat)
+{
+	seq_printf(seq, " %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu\n",
+		   stat->nr_switches, stat->nr_wakeups,
+		   stat->nr_drains, stat->nr_drains_skipped,
+		   stat->nr_idle_loops, stat->nr_steals,
+		   stat->idle_ns, stat->run_ns,
+		   stat->nr_exit_moved, stat->nr_exit_reverted,
+		   stat->exit_ns);
+}
+
+/*
+ * Zero the counters of all CPUs. Racy against the CPUs bumping them, a
+ * count in flight may survive the reset.
+ */
+void offsched_stat_reset(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		memset(per_cpu_ptr(&offsched_stat, cpu), 0,
+		       sizeof(struct offsched_stat));
+}
+
+/*
+ * One line per CPU that is offsched or has been: offsched state, runnable
+ * and bound tasks, then the counters of struct offsched_stat in order.
+ * The last line sums the counters up.
+ */
+static int show_offsched_stat(struct seq_file *seq, void *v)
+{
+	struct offsched_stat stat, sum = { };
+	struct offsched_rq *offsched_rq;
+	int cpu;
+
+	seq_printf(seq, "version %d\n", OFFSCHED_STAT_VERSION);
+
+	for_each_possible_cpu(cpu) {
+		offsched_rq = &cpu_rq(cpu)->offsched;
+		stat = per_cpu(offsched_stat, cpu);
+
+		if (!cpu_offsched(cpu) && !stat.nr_switches &&
+		    !atomic_read(&offsched_rq->nr_total))
+			continue;
+
+		seq_printf(seq, "cpu%d %d %u %d", cpu,
+			   READ_ONCE(offsched_rq->active),
+			   READ_ONCE(offsched_rq->nr_running),
+			   atomic_read(&offsched_rq->nr_total));
+		offsched_stat_show(seq, &stat);
+
+		offsched_stat_add(&sum, &stat);
+	}
+
+	seq_puts(seq, "total");
+	offsched_stat_show(seq, &sum);
+
+	return 0;
+}
+
+static int offsched_stat_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, show_offsched_stat, NULL);
+}
+
+static const struct file_operations proc_offsched_stat_operations = {
+	.open		= offsched_stat_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init proc_offsched_stat_init(void)
+{
+	proc_create("offsched_stat", 0444, NULL, &proc_offsched_stat_operations);
+	return 0;
+}
+subsys_initcall(proc_offsched_stat_init);
+
+/*
+ * /sys/kernel/debug/offsched/cpuN/, one file per counter.
+ */
+static __init int offsched_init_debug(void)
+{
+	struct offsched_stat *stat;
+	struct offsched_rq *offsched_rq;
+	struct dentry *root, *dir;
+	char name[16];
+	int cpu;
+
+	root = debugfs_create_dir("offsched", NULL);
+	if (!root)
+		return 0;
+
+	for_each_possible_cpu(cpu) {
+		offsched_rq = &cpu_rq(cpu)->offsched;
+		stat = per_cpu_ptr(&offsched_stat, cpu);
+
+		snprintf(name, sizeof(name), "cpu%d", cpu);
+		dir = debugfs_create_dir(name, root);
+		if (!dir)
+			continue;
+
+		debugfs_create_bool("active", 0444, dir, &offsched_rq->active);
+		debugfs_create_u32("nr_running", 0444, dir,
+				   &offsched_rq->nr_running);
+		debugfs_create_atomic_t("nr_total", 0444, dir,
+					&offsched_rq->nr_total);
+
+		debugfs_create_u64("nr_switches", 0444, dir, &stat->nr_switches);
+		debugfs_create_u64("nr_wakeups", 0444, dir, &stat->nr_wakeups);
+		debugfs_create_u64("nr_drains", 0444, dir, &stat->nr_drains);
+		debugfs_create_u64("nr_drains_skipped", 0444, dir,
+				   &stat->nr_drains_skipped);
+		debugfs_create_u64("nr_idle_loops", 0444, dir,
+				   &stat->nr_idle_loops);
+		debugfs_create_u64("nr_steals", 0444, dir, &stat->nr_steals);
+		debugfs_create_u64("idle_ns", 0444, dir, &stat->idle_ns);
+		debugfs_create_u64("run_ns", 0444, dir, &stat->run_ns);
+		debugfs_create_u64("nr_exit_moved", 0444, dir,
+				   &stat->nr_exit_moved);
+		debugfs_create_u64("nr_exit_reverted", 0444, dir,
+				   &stat->nr_exit_reverted);
+		debugfs_create_u64("exit_ns", 0444, dir, &stat->exit_ns);
+	}
+
+	return 0;
+}
+late_initcall(offsched_init_debug);
@@ -0,0 +1,145 @@
+/*
+ * Offsched knobs: /sys/kernel/offsched/
+ *
+ *	idle_poll_ns, idle_mwait, idle_mwait_hint, steal
+ *				offsched_idle() spin/poll policy
+ *	wakeup_preempt		OFFSCHED_PREEMPT_*
+ *	timeslice_ns		default slice, 0 is cooperative, else at
+ *				least OFFSCHED_MIN_SLICE_NS
+ *	edf_max_util		EDF admission limit, percent
+ *	exit_revert		offsched_end() reverts the tasks it pushes off
+ *	log_events		offsched log event mask, 1 << OFFSCHED_LOG_*
+ *	stats_reset		write 1 to zero /proc/offsched_stat
+ *
+ * See offsched.c for the tunables.
+ */
+#include <linux/kobject.h>
+#include <linux/sysfs.h>
+#include <linux/offsched_log.h>
+
+#include "sched.h"
+
+/* The bounds are those of the boot parameter, see offsched.c */
+#define OFFSCHED_ATTR_UINT(_name)					\
+static ssize_t _name##_show(struct kobject *kobj,			\
+			    struct kobj_attribute *attr, char *buf)	\
+{									\
+	return sprintf(buf, "%u\n", READ_ONCE(offsched_tunables._name));\
+}									\
+									\
+static ssize_t _name##_store(struct kobject *kobj,			\
+			     struct kobj_attribute *attr,		\
+			     const char *buf, size_t count)		\
+{									\
+	int ret;							\
+									\
+	ret = offsched_tunable_set_uint(&offsched_tunable_##_name, buf);\
+	return ret ? ret : count;					\
+}									\
+static struct kobj_attribute _name##_attr = __ATTR_RW(_name)
+
+#define OFFSCHED_ATTR_BOOL(_name)					\
+static ssize_t _name##_show(struct kobject *kobj,			\
+			    struct kobj_attribute *attr, char *buf)	\
+{									\
+	return sprintf(buf, "%d\n", READ_ONCE(offsched_tunables._name));\
+}									\
+									\
+static ssize_t _name##_store(struct kobject *kobj,			\
+			     struct kobj_attribute *attr,		\
+			     const char *buf, size_t count)		\
+{									\
+	bool val;							\
+	int ret;							\
+									\
+	ret = kstrtobool(buf, &val);					\
+	if (ret)							\
+		return ret;						\
+									\
+	WRITE_ONCE(offsched_tunables._name, val);			\
+	return count;							\
+}									\
+static struct kobj_attribute _name##_attr = __ATTR_RW(_name)
+
+OFFSCHED_ATTR_UINT(idle_poll_ns);
+OFFSCHED_ATTR_BOOL(idle_mwait);
+OFFSCHED_ATTR_UINT(idle_mwait_hint);
+OFFSCHED_ATTR_BOOL(steal);
+OFFSCHED_ATTR_UINT(wakeup_preempt);
+OFFSCHED_ATTR_UINT(timeslice_ns);
+OFFSCHED_ATTR_UINT(edf_max_util);
+OFFSCHED_ATTR_BOOL(exit_revert);
+
+static ssize_t log_events_show(struct kobject *kobj,
+			       struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%#lx\n", offsched_log_events());
+}
+
+static ssize_t log_events_store(struct kobject *kobj,
+				struct kobj_attribute *attr,
+				const char *buf, size_t count)
+{
+	unsigned long mask;
+	int ret;
+
+	ret = kstrtoul(buf, 0, &mask);
+	if (ret)
+		return ret;
+
+	ret = offsched_log_set_events(mask);
+	return ret ? ret : count;
+}
+static struct kobj_attribute log_events_attr = __ATTR_RW(log_events);
+
+static ssize_t stats_reset_store(struct kobject *kobj,
+				 struct kobj_attribute *attr,
+				 const char *buf, size_t count)
+{
+	bool val;
+	int ret;
+
+	ret = kstrtobool(buf, &val);
+	if (ret)
+		return ret;
+
+	if (val)
+		offsched_stat_reset();
+	return count;
+}
+static struct kobj_attribute stats_reset_attr = __ATTR_WO(stats_reset);
+
+static struct attribute *offsched_attrs[] = {
+	&idle_poll_ns_attr.attr,
+	&idle_mwait_attr.attr,
+	&idle_mwait_hint_attr.attr,
+	&steal_attr.attr,
+	&wakeup_preempt_attr.attr,
+	&timeslice_ns_attr.attr,
+	&edf_max_util_attr.attr,
+	&exit_revert_attr.attr,
+	&log_events_attr.attr,
+	&stats_reset_attr.attr,
+	NULL,
+};
+
+static const struct attribute_group offsched_attr_group = {
+	.attrs = offsched_attrs,
+};
+
+static int __init offsched_sysfs_init(void)
+{
+	struct kobject *kobj;
+	int ret;
+
+	kobj = kobject_create_and_add("offsched", kernel_kobj);
+	if (!kobj)
+		return -ENOMEM;
+
+	ret = sysfs_create_group(kobj, &offsched_attr_group);
+	if (ret)
+		kobject_put(kobj);
+
+	return ret;
+}
+subsys_initcall(offsched_sysfs_init);
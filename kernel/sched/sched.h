@@ -147,6 +147,13 @@ static inline int offsched_policy(int policy)
 	return policy == SCHED_OFFSCHED;
 }
 
+/*
+ * SCHED_OFFSCHED priorities are 0..MAX_OFFSCHED_PRIO-1 as given by
+ * sched_attr.sched_priority, a higher value wins. They only order tasks
+ * inside one offsched_rq and have nothing to do with p->prio.
+ */
+#define MAX_OFFSCHED_PRIO	100
+
 static inline bool valid_policy(int policy)
 {
 	return idle_policy(policy) || fair_policy(policy) ||
@@ -276,6 +283,23 @@ extern int dl_cpuset_cpumask_can_shrink(const struct cpumask *cur,
 					const struct cpumask *trial);
 extern bool dl_cpu_busy(unsigned int cpu);
 
+/* OFFSCHED */
+#define OFFSCHED_MIN_SLICE_NS	(10 * NSEC_PER_USEC)
+
+extern void __setparam_offsched(struct task_struct *p,
+				const struct sched_attr *attr);
+extern void __getparam_offsched(struct task_struct *p, struct sched_attr *attr);
+extern bool __checkparam_offsched(const struct sched_attr *attr);
+extern bool offsched_param_changed(struct task_struct *p,
+				   const struct sched_attr *attr);
+extern int offsched_edf_overflow(struct task_struct *p, int policy,
+				 const struct sched_attr *attr);
+extern int offsched_select_cpu(struct task_struct *p);
+extern int offsched_place_cpu(struct task_struct *p,
+			      const struct sched_attr *attr);
+extern void offsched_push_task(struct rq *rq, struct task_struct *p, int cpu);
+extern void offsched_edf_unplace(struct task_struct *p, int cpu);
+
 #ifdef CONFIG_CGROUP_SCHED
 
 #include <linux/cgroup.h>
@@ -616,14 +640,124 @@ struct dl_rq {
 };
 
 /* OFFSCHED */
+struct offsched_prio_array {
+	DECLARE_BITMAP(bitmap, MAX_OFFSCHED_PRIO+1); /* include 1 bit for delimiter */
+	struct list_head queue[MAX_OFFSCHED_PRIO];
+};
+
 struct offsched_rq {
-	struct list_head head;
+	struct offsched_prio_array active_array;
+
+	/* Remote wakeups, see ttwu_queue_offsched() */
+	struct llist_head wake_list;
+	/* Wakers that saw the CPU active and may still be queueing */
+	atomic_t nr_wakers;
+
+	/* EDF tasks, ordered by deadline, run before the priority array */
+	struct rb_root_cached edf_root;
+	/* Admitted EDF bandwidth, protected by offsched_edf_lock */
+	u64 edf_bw;
+
+	/*
+	 * nr_running is only written under rq->lock but read locklessly by
+	 * stealing siblings. nr_total counts the tasks bound to this CPU,
+	 * asleep or not, and moves with them between CPUs.
+	 */
 	unsigned int nr_running;
-	unsigned int nr_total;
+	atomic_t nr_total;
 	bool active;
-	struct task_struct *next;
+	/* Of nr_running, those work stealing may take, read the same way */
+	unsigned int nr_stealable;
+
+	/*
+	 * Queued tasks lost this CPU from their affinity, the next pick
+	 * detaches them to push_list, see offsched_push_tasks().
+	 */
+	bool push_pending;
+	struct list_head push_list;
+
+	/* local_clock() at which the current slice expires, 0 if none */
+	u64 slice_end;
+
+	/*
+	 * Rank of the running offsched task, for remote wakers that may not
+	 * look at rq->curr: curr_prio is MAX_OFFSCHED_PRIO if there is none.
+	 * See offsched_set_curr_rank().
+	 */
+	int curr_prio;
+	bool curr_edf;
+	u64 curr_deadline;
+
+	/*
+	 * Rung by remote wakers, MONITORed by offsched_idle(). Kept on its
+	 * own cache line so that unrelated rq updates don't break MWAIT.
+	 */
+	unsigned long doorbell ____cacheline_aligned_in_smp;
 };
 
+/*
+ * OFFSCHED: per-CPU counters, written by their CPU or under its rq lock,
+ * never atomically; summed up on read, see offsched_stats.c.
+ */
+struct offsched_stat {
+	u64 nr_switches;	/* switches to an offsched task */
+	u64 nr_wakeups;		/* offsched tasks woken onto this CPU */
+	u64 nr_drains;		/* non-empty wake_list batches activated */
+	u64 nr_drains_skipped;	/* picks with sleepers but nothing queued */
+	u64 nr_idle_loops;	/* offsched_idle() rounds */
+	u64 nr_steals;		/* tasks pulled from a sibling */
+	u64 idle_ns;		/* waiting in offsched_idle() */
+	u64 run_ns;		/* running offsched tasks */
+	u64 nr_exit_moved;	/* tasks pushed away by offsched_end() */
+	u64 nr_exit_reverted;	/* of those, sent back to SCHED_NORMAL */
+	u64 exit_ns;		/* pushing them */
+};
+
+DECLARE_PER_CPU_SHARED_ALIGNED(struct offsched_stat, offsched_stat);
+
+extern void offsched_stat_reset(void);
+
+/* OFFSCHED: wakeup preemption of the running offsched task */
+#define OFFSCHED_PREEMPT_NONE	0	/* it runs until it schedules */
+#define OFFSCHED_PREEMPT_PRIO	1	/* strict priority */
+#define OFFSCHED_PREEMPT_NEXT	2	/* the wakee always runs next */
+
+/*
+ * OFFSCHED: tunables, see offsched.c. Read with READ_ONCE(), written by
+ * the /sys/kernel/offsched/ attributes in offsched_sysfs.c.
+ */
+struct offsched_tunables {
+	unsigned int idle_poll_ns;
+	bool idle_mwait;
+	unsigned int idle_mwait_hint;
+	unsigned int timeslice_ns;
+	unsigned int edf_max_util;	/* percent */
+	bool steal;
+	unsigned int wakeup_preempt;	/* OFFSCHED_PREEMPT_* */
+	bool exit_revert;
+};
+
+extern struct offsched_tunables offsched_tunables;
+
+/*
+ * An unsigned tunable and its bounds, for the boot parameters and sysfs
+ * alike. With @off, 0 is valid too and turns the feature off.
+ */
+struct offsched_tunable_uint {
+	unsigned int *val;
+	unsigned int min, max;
+	bool off;
+};
+
+extern struct offsched_tunable_uint offsched_tunable_idle_poll_ns;
+extern struct offsched_tunable_uint offsched_tunable_idle_mwait_hint;
+extern struct offsched_tunable_uint offsched_tunable_timeslice_ns;
+extern struct offsched_tunable_uint offsched_tunable_edf_max_util;
+extern struct offsched_tunable_uint offsched_tunable_wakeup_preempt;
+
+extern int offsched_tunable_set_uint(struct offsched_tunable_uint *t,
+				     const char *buf);
+
 #ifdef CONFIG_SMP
 
 static inline bool sched_asym_prefer(int a, int b)
@@ -2033,6 +2167,42 @@ extern void init_cfs_rq(struct cfs_rq *cfs_rq);
 extern void init_rt_rq(struct rt_rq *rt_rq);
 extern void init_dl_rq(struct dl_rq *dl_rq);
 extern void init_offsched_rq(struct offsched_rq *offsched_rq);	/* OFFSCHED */
+extern void offsched_slice_expired(void);			/* OFFSCHED */
+extern bool offsched_wakeup_kick(struct rq *rq, struct task_struct *p);
+extern void offsched_wake_fallback(struct task_struct *p);
+#ifdef CONFIG_SMP
+extern void offsched_ttwu_pending(struct rq *rq, struct rq_flags *rf);
+extern void offsched_ttwu_ipi(void);
+#else
+static inline void offsched_ttwu_pending(struct rq *rq, struct rq_flags *rf) { }
+static inline void offsched_ttwu_ipi(void) { }
+#endif
+
+/*
+ * OFFSCHED: let an offsched CPU waiting in offsched_idle() know that work
+ * was queued for it. The work must be visible before the doorbell store.
+ */
+static inline void offsched_ring_doorbell(struct rq *rq)
+{
+	struct offsched_rq *offsched_rq = &rq->offsched;
+
+	/* Pairs with smp_mb() in offsched_idle_wait() */
+	smp_mb();
+	if (!READ_ONCE(offsched_rq->doorbell))
+		WRITE_ONCE(offsched_rq->doorbell, 1);
+}
+
+/*
+ * OFFSCHED: the only runnable task of an offsched CPU has nobody to yield
+ * to, unless a remote wakeup is pending on the wake_list.
+ */
+static inline bool offsched_yield_alone(struct rq *rq)
+{
+	return rq->curr->sched_class == &offsched_sched_class &&
+		rq->nr_running == 1 &&
+		llist_empty(&rq->offsched.wake_list) &&
+		!test_tsk_need_resched(rq->curr);
+}
 
 extern void cfs_bandwidth_usage_inc(void);
 extern void cfs_bandwidth_usage_dec(void);
@@ -0,0 +1,371 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * offsched_log: decode the offsched log rings into a text or JSON timeline.
+ *
+ *	offsched_log [-j] [-f] [-i <ms>] [-s <dump>] [<file>]
+ *
+ * <file> is /dev/offsched_log by default, or a dump taken with -s: the
+ * rings of all CPUs back to back, as the device maps them. The events of
+ * all CPUs are merged in TSC order. -j prints one JSON object per event,
+ * -f keeps following the device every -i milliseconds (100 by default).
+ *
+ * See include/uapi/linux/offsched_log.h for the format.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <linux/offsched_log.h>
+
+#define READ_ONCE(x)	(*(volatile typeof(x) *)&(x))
+
+static const char * const event_names[OFFSCHED_LOG_NR_EVENTS] = {
+	[OFFSCHED_LOG_ENQUEUE]		= "enqueue",
+	[OFFSCHED_LOG_DEQUEUE]		= "dequeue",
+	[OFFSCHED_LOG_WAKEUP]		= "wakeup",
+	[OFFSCHED_LOG_TASK_DEAD]	= "task_dead",
+	[OFFSCHED_LOG_BEGIN]		= "begin",
+	[OFFSCHED_LOG_END]		= "end",
+};
+
+struct event {
+	uint64_t tsc;
+	uint64_t payload;
+	unsigned int cpu;
+	unsigned int event;
+	int pid;
+};
+
+struct ring {
+	struct offsched_log_index *index;
+	struct offsched_log_consumer *consumer;	/* writable, or NULL */
+	unsigned int cpu;
+	uint64_t pos;		/* block being decoded */
+	uint32_t off;		/* bytes of it decoded */
+	uint64_t tsc;		/* of the last record decoded */
+};
+
+static struct ring *rings;
+static unsigned int nr_rings;
+static size_t ring_size;
+
+static struct event *events;
+static size_t nr_events, max_events;
+
+static unsigned char *block_buf;
+
+static int json;
+static uint64_t nr_lost;
+
+static void add_event(const struct event *ev)
+{
+	if (nr_events == max_events) {
+		max_events = max_events ? 2 * max_events : 4096;
+		events = realloc(events, max_events * sizeof(*events));
+		if (!events) {
+			perror("realloc");
+			exit(1);
+		}
+	}
+	events[nr_events++] = *ev;
+}
+
+static int cmp_event(const void *a, const void *b)
+{
+	const struct event *x = a, *y = b;
+
+	if (x->tsc != y->tsc)
+		return x->tsc < y->tsc ? -1 : 1;
+	return (int)x->cpu - (int)y->cpu;
+}
+
+static void print_events(void)
+{
+	const char *name;
+	char buf[16];
+	size_t i;
+
+	qsort(events, nr_events, sizeof(*events), cmp_event);
+
+	for (i = 0; i < nr_events; i++) {
+		struct event *ev = &events[i];
+
+		if (ev->event < OFFSCHED_LOG_NR_EVENTS) {
+			name = event_names[ev->event];
+		} else {
+			snprintf(buf, sizeof(buf), "event%u", ev->event);
+			name = buf;
+		}
+
+		if (json)
+			printf("{\"cpu\":%u,\"tsc\":%llu,\"event\":\"%s\",\"pid\":%d,\"payload\":%llu}\n",
+			       ev->cpu, (unsigned long long)ev->tsc, name,
+			       ev->pid, (unsigned long long)ev->payload);
+		else
+			printf("cpu=%03u tsc=%llu %-9s pid=%d payload=%llu\n",
+			       ev->cpu, (unsigned long long)ev->tsc, name,
+			       ev->pid, (unsigned long long)ev->payload);
+	}
+
+	nr_events = 0;
+	fflush(stdout);
+}
+
+static const unsigned char *get_varint(const unsigned char *p,
+				       const unsigned char *end, uint64_t *val)
+{
+	unsigned int shift = 0;
+
+	*val = 0;
+	while (p < end && shift < 64) {
+		*val |= (uint64_t)(*p & 0x7f) << shift;
+		if (!(*p++ & 0x80))
+			return p;
+		shift += 7;
+	}
+
+	return NULL;
+}
+
+/*
+ * Copy block @pos of @ring into block_buf. Returns its length, or -1 if it
+ * has been overwritten.
+ */
+static long copy_block(struct ring *ring, uint64_t pos)
+{
+	struct offsched_log_index *index = ring->index;
+	struct offsched_log_block *block;
+	uint32_t len;
+
+	block = (void *)index + 2 * getpagesize() +
+		(pos & (index->nr_blocks - 1)) * index->block_size;
+
+	if (READ_ONCE(block->seq) != pos + 1)
+		return -1;
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+	len = __atomic_load_n(&block->len, __ATOMIC_ACQUIRE);
+	if (len > index->block_size - sizeof(*block))
+		return -1;
+	memcpy(block_buf, block, sizeof(*block) + len);
+
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	if (READ_ONCE(block->seq) != pos + 1)
+		return -1;
+
+	return len;
+}
+
+static void decode_ring(struct ring *ring)
+{
+	struct offsched_log_index *index = ring->index;
+	struct offsched_log_block *block = (void *)block_buf;
+	const unsigned char *p, *end;
+	uint64_t head, val[4];
+	struct event ev;
+	long len;
+	int i;
+
+	head = __atomic_load_n(&index->head, __ATOMIC_ACQUIRE);
+	if (head - ring->pos > index->nr_blocks) {
+		nr_lost += head - index->nr_blocks - ring->pos;
+		ring->pos = head - index->nr_blocks;
+		ring->off = 0;
+	}
+
+	for (; ring->pos < head; ring->pos++, ring->off = 0) {
+		len = copy_block(ring, ring->pos);
+		if (len < 0) {
+			nr_lost++;
+			continue;
+		}
+
+		if (!ring->off)
+			ring->tsc = block->tsc;
+
+		p = block->data + ring->off;
+		end = block->data + len;
+		while (p < end) {
+			for (i = 0; i < 4 && p; i++)
+				p = get_varint(p, end, &val[i]);
+			if (!p)
+				break;
+
+			ring->tsc += val[1];
+
+			ev.cpu = ring->cpu;
+			ev.event = val[0];
+			ev.tsc = ring->tsc;
+			ev.pid = (int)val[2];
+			ev.payload = val[3];
+			add_event(&ev);
+		}
+		ring->off = len;
+
+		/* The last block still grows */
+		if (ring->pos == head - 1)
+			break;
+	}
+
+	if (ring->consumer)
+		__atomic_store_n(&ring->consumer->tail, ring->pos,
+				 __ATOMIC_RELEASE);
+}
+
+static void *map(int fd, off_t off, size_t len, int prot)
+{
+	void *addr = mmap(NULL, len, prot, MAP_SHARED, fd, off);
+
+	return addr == MAP_FAILED ? NULL : addr;
+}
+
+static void map_rings(int fd, int follow)
+{
+	struct offsched_log_index *index;
+	struct stat st;
+	unsigned int cpu;
+	off_t off;
+
+	if (fstat(fd, &st)) {
+		perror("fstat");
+		exit(1);
+	}
+
+	index = map(fd, 0, getpagesize(), PROT_READ);
+	if (!index) {
+		perror("mmap");
+		exit(1);
+	}
+	if (index->version != OFFSCHED_LOG_VERSION) {
+		fprintf(stderr, "log version %u, expected %u\n",
+			index->version, OFFSCHED_LOG_VERSION);
+		exit(1);
+	}
+	ring_size = index->size;
+	block_buf = malloc(index->block_size);
+	munmap(index, getpagesize());
+
+	for (cpu = 0; ; cpu++) {
+		struct ring *ring;
+
+		off = (off_t)cpu * ring_size;
+		if (S_ISREG(st.st_mode) && off >= st.st_size)
+			break;
+
+		index = map(fd, off, ring_size, PROT_READ);
+		if (!index) {
+			if (errno == ENODEV)
+				continue;
+			break;
+		}
+
+		rings = realloc(rings, (nr_rings + 1) * sizeof(*rings));
+		ring = &rings[nr_rings++];
+		memset(ring, 0, sizeof(*ring));
+		ring->index = index;
+		ring->cpu = index->cpu;
+
+		/* Start from the oldest block still there */
+		if (index->head > index->nr_blocks)
+			ring->pos = index->head - index->nr_blocks;
+
+		if (follow && (index->flags & OFFSCHED_LOG_STOP))
+			ring->consumer = map(fd, off + getpagesize(),
+					     getpagesize(),
+					     PROT_READ | PROT_WRITE);
+		if (ring->consumer)
+			ring->pos = ring->consumer->tail;
+	}
+}
+
+static void snapshot(const char *path)
+{
+	unsigned int i;
+	FILE *out;
+
+	out = fopen(path, "w");
+	if (!out) {
+		perror(path);
+		exit(1);
+	}
+
+	for (i = 0; i < nr_rings; i++) {
+		if (fwrite(rings[i].index, ring_size, 1, out) != 1) {
+			perror(path);
+			exit(1);
+		}
+	}
+
+	fclose(out);
+}
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: offsched_log [-j] [-f] [-i <ms>] [-s <dump>] [<file>]\n");
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	const char *path = "/dev/offsched_log", *dump = NULL;
+	unsigned int i, interval = 100;
+	int fd, opt, follow = 0;
+
+	while ((opt = getopt(argc, argv, "jfi:s:")) != -1) {
+		switch (opt) {
+		case 'j':
+			json = 1;
+			break;
+		case 'f':
+			follow = 1;
+			break;
+		case 'i':
+			interval = atoi(optarg);
+			break;
+		case 's':
+			dump = optarg;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind < argc)
+		path = argv[optind++];
+	if (optind < argc)
+		usage();
+
+	fd = open(path, follow ? O_RDWR : O_RDONLY);
+	if (fd < 0) {
+		perror(path);
+		return 1;
+	}
+
+	map_rings(fd, follow);
+
+	if (dump) {
+		snapshot(dump);
+		return 0;
+	}
+
+	do {
+		for (i = 0; i < nr_rings; i++)
+			decode_ring(&rings[i]);
+		print_events();
+
+		if (follow)
+			usleep(interval * 1000);
+	} while (follow);
+
+	if (nr_lost)
+		fprintf(stderr, "%llu blocks lost\n",
+			(unsigned long long)nr_lost);
+
+	return 0;
+}